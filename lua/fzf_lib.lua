@@ -11,12 +11,24 @@ end)()
 local native = ffi.load(library_path)
 
 ffi.cdef [[
-  typedef struct {} fzf_i16_t;
-  typedef struct {} fzf_i32_t;
   typedef struct {
-    fzf_i16_t I16;
-    fzf_i32_t I32;
-  } fzf_slab_t;
+    uint64_t fuzzy_v1_calls;
+    uint64_t fuzzy_v2_calls;
+    uint64_t exact_calls;
+    uint64_t prefix_calls;
+    uint64_t suffix_calls;
+    uint64_t equal_calls;
+    uint64_t prefilter_rejects;
+    uint64_t v1_fallbacks;
+    uint64_t heap_allocs16;
+    uint64_t heap_allocs32;
+    uint64_t bytes_scanned;
+    uint64_t bound_prunes;
+    uint64_t slab_grows;
+    uint64_t trie_shared_bytes;
+    uint64_t cached_rows;
+  } fzf_stats_t;
+  typedef struct {} fzf_slab_t;
 
   typedef struct {} fzf_term_set_t;
   typedef struct {
@@ -33,12 +45,132 @@ ffi.cdef [[
   fzf_position_t *fzf_get_positions(const char *text, fzf_pattern_t *pattern, fzf_slab_t *slab);
   void fzf_free_positions(fzf_position_t *pos);
   int32_t fzf_get_score(const char *text, fzf_pattern_t *pattern, fzf_slab_t *slab);
+  fzf_position_t *fzf_get_match(const char *text, fzf_pattern_t *pattern, fzf_slab_t *slab, int32_t *score);
+  size_t fzf_normalize_text(const char *text, size_t len, char *out);
+  void fzf_denormalize_positions(const char *text, size_t len, fzf_position_t *pos);
+
+  typedef struct {} fzf_match_cache_t;
+  fzf_match_cache_t *fzf_make_match_cache(size_t k);
+  void fzf_free_match_cache(fzf_match_cache_t *cache);
+  int32_t fzf_cached_score(fzf_match_cache_t *cache, const char *text, fzf_pattern_t *pattern, fzf_slab_t *slab);
+  fzf_position_t *fzf_cached_positions(fzf_match_cache_t *cache, const char *text, fzf_pattern_t *pattern, fzf_slab_t *slab);
 
   fzf_pattern_t *fzf_parse_pattern(int32_t case_mode, bool normalize, char *pattern, bool fuzzy);
   void fzf_free_pattern(fzf_pattern_t *pattern);
+  bool fzf_pattern_set_nth(fzf_pattern_t *pattern, char delimiter, const char *nth);
+
+  typedef struct {} fzf_corpus_t;
+  typedef struct {} fzf_stream_t;
+  typedef struct {} fzf_job_t;
+  typedef struct {} fzf_walker_t;
+  typedef struct {
+    bool hidden;
+    const char **ignore;
+    size_t ignore_count;
+    size_t threads;
+  } fzf_walk_opts_t;
+  typedef struct {
+    uint32_t idx;
+    int32_t score;
+  } fzf_match_t;
+  typedef struct {
+    fzf_match_t *data;
+    size_t size;
+    size_t cap;
+  } fzf_matches_t;
+  typedef struct {
+    size_t size;
+    uint32_t *idx;
+    int32_t *score;
+    uint32_t *begin;
+    uint32_t *end;
+    uint64_t refs;
+  } fzf_result_buf_t;
+
+  fzf_corpus_t *fzf_make_corpus(void);
+  fzf_corpus_t *fzf_make_dedup_corpus(void);
+  size_t fzf_corpus_inputs(fzf_corpus_t *corpus);
+  void fzf_corpus_basename_first(fzf_corpus_t *corpus, bool enable);
+  void fzf_corpus_normalize(fzf_corpus_t *corpus, bool enable);
+  const uint32_t *fzf_corpus_fanout(fzf_corpus_t *corpus, size_t idx, size_t *n);
+  void fzf_free_corpus(fzf_corpus_t *corpus);
+  void fzf_corpus_append(fzf_corpus_t *corpus, const char *item, size_t len);
+  size_t fzf_corpus_count(fzf_corpus_t *corpus);
+  const char *fzf_corpus_get(fzf_corpus_t *corpus, size_t idx, size_t *len);
+  fzf_corpus_t *fzf_load_corpus(const char *path);
+  bool fzf_save_index(fzf_corpus_t *corpus, const char *path, const char *root);
+  fzf_corpus_t *fzf_load_index(const char *path, const char *root);
+
+  typedef struct {
+    const float *weights;
+    size_t count;
+    int32_t mode;
+    float factor;
+  } fzf_blend_t;
 
+  fzf_stream_t *fzf_make_stream(int32_t case_mode, bool normalize, bool fuzzy, size_t k);
+  void fzf_free_stream(fzf_stream_t *stream);
+  void fzf_stream_push(fzf_stream_t *stream, const char **items, const size_t *lens, size_t n, fzf_slab_t *slab);
+  void fzf_stream_set_prompt(fzf_stream_t *stream, const char *prompt, fzf_slab_t *slab);
+  bool fzf_stream_set_nth(fzf_stream_t *stream, char delimiter, const char *nth, fzf_slab_t *slab);
+  void fzf_stream_set_blend(fzf_stream_t *stream, const fzf_blend_t *blend, fzf_slab_t *slab);
+  void fzf_stream_row_cache(fzf_stream_t *stream, bool enable);
+  void fzf_stream_update(fzf_stream_t *stream, fzf_slab_t *slab);
+  fzf_corpus_t *fzf_stream_corpus(fzf_stream_t *stream);
+  size_t fzf_stream_matched(fzf_stream_t *stream);
+  const fzf_matches_t *fzf_stream_top(fzf_stream_t *stream);
+  const fzf_matches_t *fzf_stream_all(fzf_stream_t *stream);
+  fzf_result_buf_t *fzf_stream_result(fzf_stream_t *stream, bool all, bool ranges, fzf_slab_t *slab);
+  fzf_result_buf_t *fzf_retain_result_buf(fzf_result_buf_t *buf);
+  void fzf_release_result_buf(fzf_result_buf_t *buf);
+
+  void fzf_scheduler_init(size_t threads);
+  void fzf_scheduler_shutdown(void);
+  size_t fzf_scheduler_threads(void);
+  fzf_job_t *fzf_submit_job(fzf_corpus_t *corpus, const char *prompt, int32_t case_mode, bool normalize, bool fuzzy, size_t k, int32_t priority, uint64_t owner);
+  int32_t fzf_job_poll(fzf_job_t *job);
+  const fzf_matches_t *fzf_job_collect(fzf_job_t *job);
+  fzf_result_buf_t *fzf_job_result(fzf_job_t *job);
+  size_t fzf_job_matched(fzf_job_t *job);
+  void fzf_job_cancel(fzf_job_t *job);
+  void fzf_free_job(fzf_job_t *job);
+
+  fzf_walker_t *fzf_walk_start(const char *root, fzf_walk_opts_t opts);
+  size_t fzf_walk_drain(fzf_walker_t *walker, fzf_corpus_t *corpus);
+  bool fzf_walk_done(fzf_walker_t *walker);
+  void fzf_walk_cancel(fzf_walker_t *walker);
+  void fzf_free_walker(fzf_walker_t *walker);
+
+  typedef struct {
+    size_t size_16;
+    size_t size_32;
+    bool auto_size;
+    bool huge_pages;
+  } fzf_slab_config_t;
+  fzf_slab_t *fzf_make_slab(fzf_slab_config_t config);
   fzf_slab_t *fzf_make_default_slab(void);
   void fzf_free_slab(fzf_slab_t *slab);
+  fzf_slab_t *fzf_acquire_slab(void);
+  void fzf_release_slab(fzf_slab_t *slab);
+  void fzf_set_slab_pool_config(fzf_slab_config_t config);
+
+  void fzf_enable_stats(fzf_slab_t *slab);
+  void fzf_disable_stats(fzf_slab_t *slab);
+  void fzf_reset_stats(fzf_slab_t *slab);
+  const fzf_stats_t *fzf_get_stats(fzf_slab_t *slab);
+
+  typedef struct {
+    uint64_t buckets[64];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+  } fzf_histogram_t;
+
+  void fzf_enable_timing(void);
+  void fzf_disable_timing(void);
+  void fzf_reset_timing(void);
+  void fzf_get_timing(int32_t probe, fzf_histogram_t *out);
+  uint64_t fzf_histogram_percentile(const fzf_histogram_t *hist, double p);
 ]]
 
 local fzf = {}
@@ -47,11 +179,14 @@ fzf.get_score = function(input, pattern_struct, slab)
   return native.fzf_get_score(input, pattern_struct, slab)
 end
 
-fzf.get_pos = function(input, pattern_struct, slab)
-  local pos = native.fzf_get_positions(input, pattern_struct, slab)
+-- original is the line that input was normalized from, see normalize_text
+local pos_to_table = function(pos, input, original)
   if pos == nil then
     return
   end
+  if original and original ~= input then
+    native.fzf_denormalize_positions(original, #original, pos)
+  end
 
   local res = {}
   for i = 1, tonumber(pos.size) do
@@ -62,24 +197,489 @@ fzf.get_pos = function(input, pattern_struct, slab)
   return res
 end
 
-fzf.parse_pattern = function(pattern, case_mode, fuzzy)
+-- original: the line input was normalized from, positions then refer to it
+fzf.get_pos = function(input, pattern_struct, slab, original)
+  return pos_to_table(native.fzf_get_positions(input, pattern_struct, slab), input, original)
+end
+
+-- score and positions in one pass, positions are nil if it doesn't match
+fzf.get_score_and_pos = function(input, pattern_struct, slab)
+  local score = ffi.new "int32_t[1]"
+  local pos = native.fzf_get_match(input, pattern_struct, slab, score)
+  return score[0], pos_to_table(pos)
+end
+
+-- keeps the positions of the k best items scored with cached_score for the
+-- same pattern, cached_pos then returns them without matching again
+fzf.make_match_cache = function(k)
+  return native.fzf_make_match_cache(k or 128)
+end
+
+fzf.free_match_cache = function(cache)
+  native.fzf_free_match_cache(cache)
+end
+
+fzf.cached_score = function(cache, input, pattern_struct, slab)
+  return native.fzf_cached_score(cache, input, pattern_struct, slab)
+end
+
+fzf.cached_pos = function(cache, input, pattern_struct, slab, original)
+  return pos_to_table(native.fzf_cached_positions(cache, input, pattern_struct, slab), input, original)
+end
+
+local normalize_buf = ffi.new("char[?]", 256)
+local normalize_cap = 256
+
+-- line with latin letters replaced by their ascii letter, line itself if
+-- nothing changes. Match it with a pattern parsed from the normalized prompt
+-- without normalize to normalize every line only once
+fzf.normalize_text = function(line)
+  if #line > normalize_cap then
+    normalize_cap = #line
+    normalize_buf = ffi.new("char[?]", normalize_cap)
+  end
+  local len = tonumber(native.fzf_normalize_text(line, #line, normalize_buf))
+  if len == #line then
+    return line
+  end
+  return ffi.string(normalize_buf, len)
+end
+
+-- normalize matches latin letters as their ascii letter, "cafe" finds "café"
+fzf.parse_pattern = function(pattern, case_mode, fuzzy, normalize)
   case_mode = case_mode == nil and 0 or case_mode
   fuzzy = fuzzy == nil and true or fuzzy
   local c_str = ffi.new("char[?]", #pattern + 1)
   ffi.copy(c_str, pattern)
-  return native.fzf_parse_pattern(case_mode, false, c_str, fuzzy)
+  return native.fzf_parse_pattern(case_mode, normalize == true, c_str, fuzzy)
 end
 
 fzf.free_pattern = function(p)
   native.fzf_free_pattern(p)
 end
 
-fzf.allocate_slab = function()
-  return native.fzf_make_default_slab()
+-- only match fields of each line, like fzf's --nth. target is a pattern or a
+-- stream, delimiter a single character (nil splits on whitespace) and nth a
+-- string like "1", "-1" or "2..,..3" (nil matches whole lines again). Returns
+-- false if nth is invalid
+fzf.set_nth = function(target, delimiter, nth, slab)
+  local d = delimiter and delimiter:byte() or 0
+  if ffi.istype("fzf_stream_t *", target) then
+    return native.fzf_stream_set_nth(target, d, nth, slab)
+  end
+  return native.fzf_pattern_set_nth(target, d, nth)
+end
+
+local matches_to_table = function(matches)
+  local res = {}
+  for i = 1, tonumber(matches.size) do
+    local match = matches.data[i - 1]
+    res[i] = { idx = match.idx + 1, score = match.score }
+  end
+  return res
+end
+
+-- opts: dedup (store and score identical items once, see corpus_fanout)
+fzf.make_corpus = function(opts)
+  if opts and opts.dedup then
+    return native.fzf_make_dedup_corpus()
+  end
+  return native.fzf_make_corpus()
+end
+
+fzf.free_corpus = function(corpus)
+  native.fzf_free_corpus(corpus)
+end
+
+fzf.corpus_append = function(corpus, items)
+  for i = 1, #items do
+    native.fzf_corpus_append(corpus, items[i], #items[i])
+  end
+end
+
+-- maps a newline delimited file, returns nil if it can't be read. Lines are
+-- only turned into lua strings with corpus_get
+fzf.load_corpus = function(path)
+  local corpus = native.fzf_load_corpus(path)
+  if corpus == nil then
+    return
+  end
+  return corpus
+end
+
+-- writes the corpus to path, keyed by root (the directory or file the corpus
+-- was built from). Returns false if it can't be written
+fzf.save_index = function(corpus, path, root)
+  return native.fzf_save_index(corpus, path, root)
+end
+
+-- maps an index written by save_index, returns nil if it is missing or stale
+-- because root changed since
+fzf.load_index = function(path, root)
+  local corpus = native.fzf_load_index(path, root)
+  if corpus == nil then
+    return
+  end
+  return corpus
+end
+
+fzf.corpus_count = function(corpus)
+  return tonumber(native.fzf_corpus_count(corpus))
+end
+
+-- match terms against the file name of each path first, target is a corpus or
+-- a stream. Applies to everything scored afterwards
+fzf.basename_first = function(target, enable)
+  if ffi.istype("fzf_stream_t *", target) then
+    target = native.fzf_stream_corpus(target)
+  end
+  native.fzf_corpus_basename_first(target, enable ~= false)
+end
+
+-- keep a normalized copy of lines with latin letters, so patterns parsed with
+-- normalize don't normalize every line on each call. target is a corpus or a
+-- stream, streams made with normalize keep them already
+fzf.normalize = function(target, enable)
+  if ffi.istype("fzf_stream_t *", target) then
+    target = native.fzf_stream_corpus(target)
+  end
+  native.fzf_corpus_normalize(target, enable ~= false)
+end
+
+-- amount of appended items, corpus_count counts distinct items
+fzf.corpus_inputs = function(corpus)
+  return tonumber(native.fzf_corpus_inputs(corpus))
+end
+
+-- the appended items (1 based, in append order) behind distinct item idx of
+-- a dedup corpus
+fzf.corpus_fanout = function(corpus, idx)
+  local n = ffi.new "size_t[1]"
+  local fanout = native.fzf_corpus_fanout(corpus, idx - 1, n)
+  local res = {}
+  for i = 1, tonumber(n[0]) do
+    res[i] = fanout[i - 1] + 1
+  end
+  return res
+end
+
+-- idx is 1 based
+fzf.corpus_get = function(corpus, idx)
+  local len = ffi.new "size_t[1]"
+  local data = native.fzf_corpus_get(corpus, idx - 1, len)
+  return ffi.string(data, len[0])
+end
+
+-- normalize: parse prompts with normalize, see parse_pattern. default false
+fzf.make_stream = function(case_mode, fuzzy, k, normalize)
+  case_mode = case_mode == nil and 0 or case_mode
+  fuzzy = fuzzy == nil and true or fuzzy
+  return native.fzf_make_stream(case_mode, normalize == true, fuzzy, k or 50)
+end
+
+fzf.free_stream = function(stream)
+  native.fzf_free_stream(stream)
+end
+
+fzf.stream_push = function(stream, items, slab)
+  local n = #items
+  if n == 0 then
+    return
+  end
+  local c_items = ffi.new("const char *[?]", n)
+  local lens = ffi.new("size_t[?]", n)
+  for i = 1, n do
+    c_items[i - 1] = items[i]
+    lens[i - 1] = #items[i]
+  end
+  native.fzf_stream_push(stream, c_items, lens, n, slab)
+end
+
+fzf.stream_set_prompt = function(stream, prompt, slab)
+  native.fzf_stream_set_prompt(stream, prompt, slab)
+end
+
+-- keep the last matrix row of every match while the prompt is a single fuzzy
+-- term, so typing one more character only computes one row per match
+fzf.stream_row_cache = function(stream, enable)
+  native.fzf_stream_row_cache(stream, enable ~= false)
+end
+
+local blend_modes = { add = 0, scale = 1 }
+-- keeps the native weights alive as long as the stream uses them
+local stream_weights = setmetatable({}, { __mode = "k" })
+
+-- weights: list of numbers (e.g. frecency) by 1 based item index, items
+-- without a weight weigh 0. nil turns blending off.
+-- opts: mode ("add": score + factor * weight, "scale":
+-- score * (1 + factor * weight), default "add") and factor (default 1)
+fzf.stream_set_weights = function(stream, weights, opts, slab)
+  if weights == nil then
+    stream_weights[stream] = nil
+    native.fzf_stream_set_blend(stream, nil, slab)
+    return
+  end
+  opts = opts or {}
+  local n = #weights
+  local c_weights = ffi.new("float[?]", math.max(n, 1))
+  for i = 1, n do
+    c_weights[i - 1] = weights[i]
+  end
+  stream_weights[stream] = c_weights
+  local blend = ffi.new "fzf_blend_t"
+  blend.weights = c_weights
+  blend.count = n
+  blend.mode = blend_modes[opts.mode or "add"]
+  blend.factor = opts.factor or 1
+  native.fzf_stream_set_blend(stream, blend, slab)
+end
+
+fzf.stream_matched = function(stream)
+  return tonumber(native.fzf_stream_matched(stream))
+end
+
+-- returns the best k matches as { idx = 1 based item index, score = score }
+fzf.stream_top = function(stream)
+  return matches_to_table(native.fzf_stream_top(stream))
+end
+
+-- every match in the same format and order as stream_top
+fzf.stream_all = function(stream)
+  return matches_to_table(native.fzf_stream_all(stream))
+end
+
+-- same as stream_top (or stream_all with opts.all) without building a table.
+-- Returns a cdata with size, idx, score and, with opts.ranges, begin and end
+-- (the bounds of the matched bytes). The arrays and item indices are 0 based,
+-- e.g. res.idx[0] is the best match. Freed when it is garbage collected
+fzf.stream_result = function(stream, opts, slab)
+  opts = opts or {}
+  local res = native.fzf_stream_result(stream, opts.all or false, opts.ranges or false, slab)
+  return ffi.gc(res, native.fzf_release_result_buf)
+end
+
+local job_states = { [0] = "running", [1] = "done", [2] = "cancelled" }
+
+-- threads: upper bound of worker threads shared by all jobs, 0 picks the
+-- amount of cpus (at most 8). Only has an effect before the first job.
+fzf.scheduler_init = function(threads)
+  native.fzf_scheduler_init(threads or 0)
+end
+
+fzf.scheduler_shutdown = function()
+  native.fzf_scheduler_shutdown()
+end
+
+-- opts: case_mode, normalize, fuzzy, k (default 50), priority (higher runs
+-- first, default 0) and owner (number, a new job cancels the previous jobs of
+-- the same owner, 0 disables that)
+fzf.submit_job = function(corpus, prompt, opts)
+  opts = opts or {}
+  local case_mode = opts.case_mode == nil and 0 or opts.case_mode
+  local fuzzy = opts.fuzzy == nil and true or opts.fuzzy
+  return native.fzf_submit_job(
+    corpus,
+    prompt,
+    case_mode,
+    opts.normalize == true,
+    fuzzy,
+    opts.k or 50,
+    opts.priority or 0,
+    opts.owner or 0
+  )
+end
+
+-- "running", "done" or "cancelled", never blocks
+fzf.job_poll = function(job)
+  return job_states[native.fzf_job_poll(job)]
+end
+
+-- blocks until the job is done, returns nil if it was cancelled
+fzf.job_collect = function(job)
+  local res = native.fzf_job_collect(job)
+  if res == nil then
+    return
+  end
+  return matches_to_table(res), tonumber(native.fzf_job_matched(job))
+end
+
+-- job_collect as a result cdata, see stream_result. nil if it was cancelled
+fzf.job_result = function(job)
+  local res = native.fzf_job_result(job)
+  if res == nil then
+    return
+  end
+  return ffi.gc(res, native.fzf_release_result_buf)
+end
+
+fzf.job_cancel = function(job)
+  native.fzf_job_cancel(job)
+end
+
+fzf.free_job = function(job)
+  native.fzf_free_job(job)
+end
+
+-- opts: hidden (default false), ignore (list of fnmatch patterns matched
+-- against file and directory names) and threads (0 picks the amount of cpus).
+-- Returns nil if root can't be opened
+fzf.walk_start = function(root, opts)
+  opts = opts or {}
+  local ignore = opts.ignore or {}
+  local c_opts = ffi.new "fzf_walk_opts_t"
+  c_opts.hidden = opts.hidden or false
+  c_opts.threads = opts.threads or 0
+  c_opts.ignore_count = #ignore
+  local c_ignore = ffi.new("const char *[?]", #ignore + 1)
+  for i = 1, #ignore do
+    c_ignore[i - 1] = ignore[i]
+  end
+  c_opts.ignore = c_ignore
+  local walker = native.fzf_walk_start(root, c_opts)
+  if walker == nil then
+    return
+  end
+  return walker
+end
+
+-- moves the files found so far into target, either a corpus or a stream. A
+-- stream also scores them against its prompt (needs a slab). Returns the
+-- number of new items
+fzf.walk_drain = function(walker, target, slab)
+  if ffi.istype("fzf_stream_t *", target) then
+    local n = native.fzf_walk_drain(walker, native.fzf_stream_corpus(target))
+    native.fzf_stream_update(target, slab)
+    return tonumber(n)
+  end
+  return tonumber(native.fzf_walk_drain(walker, target))
+end
+
+fzf.walk_done = function(walker)
+  return native.fzf_walk_done(walker)
+end
+
+fzf.walk_cancel = function(walker)
+  native.fzf_walk_cancel(walker)
+end
+
+fzf.free_walker = function(walker)
+  native.fzf_free_walker(walker)
+end
+
+-- opts: size_16 and size_32 (elements), auto_size (grow to the longest
+-- item instead of falling back to v1) and huge_pages. nil opts make a default
+-- slab
+local slab_config = function(opts)
+  return ffi.new("fzf_slab_config_t", {
+    opts.size_16 or 100 * 1024,
+    opts.size_32 or 2048,
+    opts.auto_size or false,
+    opts.huge_pages or false,
+  })
+end
+
+fzf.allocate_slab = function(opts)
+  if opts == nil then
+    return native.fzf_make_default_slab()
+  end
+  return native.fzf_make_slab(slab_config(opts))
 end
 
 fzf.free_slab = function(s)
   native.fzf_free_slab(s)
 end
 
+-- pooled slabs, reused across sorters instead of allocated for each one
+fzf.acquire_slab = function()
+  return native.fzf_acquire_slab()
+end
+
+fzf.release_slab = function(s)
+  native.fzf_release_slab(s)
+end
+
+-- same opts as allocate_slab, for every slab acquired from now on
+fzf.configure_slabs = function(opts)
+  native.fzf_set_slab_pool_config(slab_config(opts))
+end
+
+local stat_fields = {
+  "fuzzy_v1_calls",
+  "fuzzy_v2_calls",
+  "exact_calls",
+  "prefix_calls",
+  "suffix_calls",
+  "equal_calls",
+  "prefilter_rejects",
+  "v1_fallbacks",
+  "heap_allocs16",
+  "heap_allocs32",
+  "bytes_scanned",
+  "bound_prunes",
+  "slab_grows",
+  "trie_shared_bytes",
+  "cached_rows",
+}
+
+fzf.enable_stats = function(s)
+  native.fzf_enable_stats(s)
+end
+
+fzf.disable_stats = function(s)
+  native.fzf_disable_stats(s)
+end
+
+fzf.reset_stats = function(s)
+  native.fzf_reset_stats(s)
+end
+
+fzf.get_stats = function(s)
+  local stats = native.fzf_get_stats(s)
+  if stats == nil then
+    return
+  end
+
+  local res = {}
+  for _, field in ipairs(stat_fields) do
+    res[field] = tonumber(stats[field])
+  end
+  return res
+end
+
+local probes = {
+  parse_pattern = 0,
+  get_score = 1,
+  get_positions = 2,
+}
+
+fzf.enable_timing = function()
+  native.fzf_enable_timing()
+end
+
+fzf.disable_timing = function()
+  native.fzf_disable_timing()
+end
+
+fzf.reset_timing = function()
+  native.fzf_reset_timing()
+end
+
+fzf.get_timing = function(probe)
+  local id = probes[probe]
+  if id == nil then
+    error(string.format("%s is not a valid probe", probe))
+  end
+
+  local hist = ffi.new "fzf_histogram_t"
+  native.fzf_get_timing(id, hist)
+  return {
+    count = tonumber(hist.count),
+    total_ns = tonumber(hist.total_ns),
+    max_ns = tonumber(hist.max_ns),
+    p50_ns = tonumber(native.fzf_histogram_percentile(hist, 0.50)),
+    p95_ns = tonumber(native.fzf_histogram_percentile(hist, 0.95)),
+    p99_ns = tonumber(native.fzf_histogram_percentile(hist, 0.99)),
+  }
+end
+
 return fzf
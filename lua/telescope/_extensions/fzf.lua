@@ -17,6 +17,7 @@ local case_enum = setmetatable({
 local get_fzf_sorter = function(opts)
   local case_mode = case_enum[opts.case_mode]
   local fuzzy_mode = opts.fuzzy == nil and true or opts.fuzzy
+  local normalize = opts.normalize ~= false
   local post_or = false
   local post_inv = false
   local post_escape = false
@@ -24,12 +25,29 @@ local get_fzf_sorter = function(opts)
   local get_struct = function(self, prompt)
     local struct = self.state.prompt_cache[prompt]
     if not struct then
-      struct = fzf.parse_pattern(prompt, case_mode, fuzzy_mode)
+      -- lines are normalized once in get_line, so the pattern doesn't have to
+      struct = fzf.parse_pattern(normalize and fzf.normalize_text(prompt) or prompt, case_mode, fuzzy_mode)
+      if opts.nth and not fzf.set_nth(struct, opts.delimiter, opts.nth) then
+        error(string.format("%s is not a valid nth", opts.nth))
+      end
       self.state.prompt_cache[prompt] = struct
     end
     return struct
   end
 
+  -- every line is normalized once per picker, not on every keystroke
+  local get_line = function(self, line)
+    if not normalize then
+      return line
+    end
+    local normalized = self.state.normalized[line]
+    if not normalized then
+      normalized = fzf.normalize_text(line)
+      self.state.normalized[line] = normalized
+    end
+    return normalized
+  end
+
   local clear_filter_fun = function(self, prompt)
     local filter = "^(" .. self._delimiter .. "(%S+)" .. "[" .. self._delimiter .. "%s]" .. ")"
     local matched = prompt:match(filter)
@@ -42,8 +60,10 @@ local get_fzf_sorter = function(opts)
 
   return sorters.Sorter:new {
     init = function(self)
-      self.state.slab = fzf.allocate_slab()
+      self.state.slab = fzf.acquire_slab()
+      self.state.match_cache = fzf.make_match_cache(128)
       self.state.prompt_cache = {}
+      self.state.normalized = {}
 
       if self.filter_function then
         self.__highlight_prefilter = clear_filter_fun
@@ -54,10 +74,15 @@ local get_fzf_sorter = function(opts)
         fzf.free_pattern(v)
       end
       self.state.prompt_cache = {}
+      self.state.normalized = {}
       if self.state.slab ~= nil then
-        fzf.free_slab(self.state.slab)
+        fzf.release_slab(self.state.slab)
         self.state.slab = nil
       end
+      if self.state.match_cache ~= nil then
+        fzf.free_match_cache(self.state.match_cache)
+        self.state.match_cache = nil
+      end
     end,
     start = function(self, prompt)
       local last = prompt:sub(-1, -1)
@@ -94,7 +119,7 @@ local get_fzf_sorter = function(opts)
     discard = true,
     scoring_function = function(self, prompt, line)
       local obj = get_struct(self, prompt)
-      local score = fzf.get_score(line, obj, self.state.slab)
+      local score = fzf.cached_score(self.state.match_cache, get_line(self, line), obj, self.state.slab)
       if score == 0 then
         return -1
       else
@@ -105,7 +130,9 @@ local get_fzf_sorter = function(opts)
       if self.__highlight_prefilter then
         prompt = self:__highlight_prefilter(prompt)
       end
-      return fzf.get_pos(display, get_struct(self, prompt), self.state.slab)
+      -- the best rows were matched with positions while scoring
+      local obj = get_struct(self, prompt)
+      return fzf.cached_pos(self.state.match_cache, get_line(self, display), obj, self.state.slab, display)
     end,
   }
 end
@@ -114,6 +141,9 @@ local fast_extend = function(opts, conf)
   local ret = {}
   ret.case_mode = vim.F.if_nil(opts.case_mode, conf.case_mode)
   ret.fuzzy = vim.F.if_nil(opts.fuzzy, conf.fuzzy)
+  ret.normalize = vim.F.if_nil(opts.normalize, conf.normalize)
+  ret.delimiter = vim.F.if_nil(opts.delimiter, conf.delimiter)
+  ret.nth = vim.F.if_nil(opts.nth, conf.nth)
   return ret
 end
 
@@ -132,6 +162,10 @@ return require("telescope").register_extension {
     local conf = {}
     conf.case_mode = vim.F.if_nil(ext_config.case_mode, "smart_case")
     conf.fuzzy = vim.F.if_nil(ext_config.fuzzy, true)
+    conf.normalize = vim.F.if_nil(ext_config.normalize, true)
+    if ext_config.slab then
+      fzf.configure_slabs(ext_config.slab)
+    end
 
     if override_file then
       config.file_sorter = wrap_sorter(conf)
@@ -2,7 +2,24 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <sys/stat.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef FZF_USDT
+#include <sys/sdt.h>
+#endif
 
 // TODO(conni2461): UNICODE HEADER
 #define UNICODE_MAXASCII 0x7f
@@ -12,6 +29,15 @@
     free(x);                                                                   \
   }
 
+#ifdef FZF_NO_STATS
+#define STAT_ADD(slab, field, n)
+#else
+#define STAT_ADD(slab, field, n)                                               \
+  if ((slab) && (slab)->stats) {                                               \
+    (slab)->stats->field += (n);                                               \
+  }
+#endif
+
 /* Helpers */
 #define free_alloc(obj)                                                        \
   if ((obj).allocated) {                                                       \
@@ -39,6 +65,12 @@ gen_slice(str, const char);
 #undef gen_slice
 #undef gen_simple_slice
 
+#ifdef _MSC_VER
+#define always_inline __forceinline
+#else
+#define always_inline inline __attribute__((always_inline))
+#endif
+
 /* TODO(conni2461): additional types (utf8) */
 typedef int32_t char_class;
 typedef char byte;
@@ -249,6 +281,81 @@ static void insert_range(fzf_position_t *pos, size_t start, size_t end) {
   }
 }
 
+/* Slab buffers start on a cache line. With huge_pages, buffers of at least a
+ * huge page are aligned to one and madvised, so the kernel can back them with
+ * transparent huge pages. Auto sized slabs never grow beyond SLAB_AUTO_MAX_16
+ * elements, longer items still fall back to v1 */
+#define SLAB_ALIGN 64
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+#define SLAB_AUTO_MAX_16 ((size_t)16 * 1024 * 1024)
+
+static const fzf_slab_config_t default_slab_config = {(size_t)100 * 1024, 2048,
+                                                      false, false};
+
+static void *slab_buffer(size_t size, bool huge_pages) {
+  size = size > 0 ? size : 1;
+#ifdef _WIN32
+  // large pages need a privilege on windows, so huge_pages is ignored
+  void *data = _aligned_malloc(size, SLAB_ALIGN);
+#else
+  size_t align = SLAB_ALIGN;
+#ifdef MADV_HUGEPAGE
+  if (huge_pages && size >= HUGE_PAGE_SIZE) {
+    align = HUGE_PAGE_SIZE;
+  }
+#endif
+  void *data = NULL;
+  if (posix_memalign(&data, align, size) != 0) {
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if (align == HUGE_PAGE_SIZE) {
+    madvise(data, size, MADV_HUGEPAGE);
+  }
+#endif
+#endif
+  memset(data, 0, size);
+  return data;
+}
+
+static void free_slab_buffer(void *data) {
+#ifdef _WIN32
+  _aligned_free(data);
+#else
+  free(data);
+#endif
+}
+
+static size_t grown_cap(size_t cap, size_t need) {
+  cap = cap > 0 ? cap : 1;
+  while (cap <= need) {
+    cap *= 2;
+  }
+  return cap < SLAB_AUTO_MAX_16 ? cap : SLAB_AUTO_MAX_16;
+}
+
+/* makes an auto sized slab large enough for need_16 and need_32 elements,
+ * the old contents are dropped */
+static void slab_reserve(fzf_slab_t *slab, size_t need_16, size_t need_32) {
+  if (!slab->config.auto_size || need_16 >= SLAB_AUTO_MAX_16) {
+    return;
+  }
+  if (need_16 >= slab->I16.cap) {
+    free_slab_buffer(slab->I16.data);
+    slab->I16.cap = grown_cap(slab->I16.cap, need_16);
+    slab->I16.data = (int16_t *)slab_buffer(slab->I16.cap * sizeof(int16_t),
+                                            slab->config.huge_pages);
+    STAT_ADD(slab, slab_grows, 1);
+  }
+  if (need_32 >= slab->I32.cap) {
+    free_slab_buffer(slab->I32.data);
+    slab->I32.cap = grown_cap(slab->I32.cap, need_32);
+    slab->I32.data = (int32_t *)slab_buffer(slab->I32.cap * sizeof(int32_t),
+                                            slab->config.huge_pages);
+    STAT_ADD(slab, slab_grows, 1);
+  }
+}
+
 static fzf_i16_t alloc16(size_t *offset, fzf_slab_t *slab, size_t size) {
   if (slab != NULL && slab->I16.cap > *offset + size) {
     i16_slice_t slice = slice_i16(slab->I16.data, *offset, (*offset) + size);
@@ -258,6 +365,7 @@ static fzf_i16_t alloc16(size_t *offset, fzf_slab_t *slab, size_t size) {
                        .cap = slice.size,
                        .allocated = false};
   }
+  STAT_ADD(slab, heap_allocs16, 1);
   int16_t *data = (int16_t *)malloc(size * sizeof(int16_t));
   memset(data, 0, size * sizeof(int16_t));
   return (fzf_i16_t){
@@ -273,6 +381,7 @@ static fzf_i32_t alloc32(size_t *offset, fzf_slab_t *slab, size_t size) {
                        .cap = slice.size,
                        .allocated = false};
   }
+  STAT_ADD(slab, heap_allocs32, 1);
   int32_t *data = (int32_t *)malloc(size * sizeof(int32_t));
   memset(data, 0, size * sizeof(int32_t));
   return (fzf_i32_t){
@@ -326,16 +435,116 @@ static int16_t bonus_at(fzf_string_t *input, size_t idx) {
                    char_class_of(input->data[idx]));
 }
 
-/* TODO(conni2461): maybe just not do this */
+/* Normalization
+ *
+ * Latin letters with diacritics are matched as their ASCII letter like fzf
+ * does, so "cafe" finds "café". Runes are a few UTF-8 bytes, the matchers only
+ * see bytes, so the text is normalized as a whole before matching. A corpus
+ * does it once per item on append, see fzf_corpus_normalize. */
+
+// ASCII letter of each rune in U+00C0 - U+024F, '.' keeps the rune
+static const char latin_runes[] =
+    "AAAAAA.CEEEEIIII.NOOOOO.OUUUUY..aaaaaa.ceeeeiiii.nooooo.ouuuuy.y"
+    "AaAaAaCcCcCcCcDdDdEeEeEeEeEeGgGgGgGgHhHhIiIiIiIiIi..JjKk.LlLlLl."
+    ".LlNnNnNn...OoOoOo..RrRrRrSsSsSsSsTtTtTtUuUuUuUuUuUuWwYyYZzZzZz."
+    "b........D.......Ff....IKkl.....Oo..Pp......Tt.Uu..YyZz........."
+    ".............AaIiOoUuUuUuUuUu.AaAa..GgGgKkOoOo..j...Gg..NnAa...."
+    "AaAaEeEeIiIiOoOoRrRrUuUuSsTt..Hh......AaEeOoOoOoOoYy......ACc.T."
+    "...B..EeJj..RrYy";
+
+// and in U+1E00 - U+1EFF (Latin Extended Additional)
+static const char latin_ext_runes[] =
+    "AaBbBbBbCcDdDdDdDdDdEeEeEeEeEeFfGgHhHhHhHhHhIiIiKkKkKkLlLlLlLlMm"
+    "MmMmNnNnNnNnOoOoOoOoPpPpRrRrRrRrSsSsSsSsSsTtTtTtTtUuUuUuUuUuVvVv"
+    "WwWwWwWwWwXxXxYyZzZzZzhtwy......AaAaAaAaAaAaAaAaAaAaAaAaEeEeEeEe"
+    "EeEeEeEeIiIiOoOoOoOoOoOoOoOoOoOoOoOoUuUuUuUuUuUuUuYyYyYyYy......";
+
+static bool is_continuation(unsigned char c) {
+  return (c & 0xC0) == 0x80;
+}
+
+/* ASCII letter of the rune at text[i] and its length in bytes, 0 if the rune
+ * doesn't change */
+static char latin_letter(const unsigned char *text, size_t len, size_t i,
+                         size_t *n) {
+  unsigned char c = text[i];
+  char letter = '.';
+  if (c >= 0xC3 && c <= 0xC9 && i + 1 < len && is_continuation(text[i + 1])) {
+    uint32_t r = (uint32_t)(c & 0x1F) << 6 | (text[i + 1] & 0x3F);
+    if (r <= 0x24F) {
+      letter = latin_runes[r - 0xC0];
+      *n = 2;
+    }
+  } else if (c == 0xE1 && i + 2 < len && text[i + 1] >= 0xB8 &&
+             text[i + 1] <= 0xBB && is_continuation(text[i + 2])) {
+    letter = latin_ext_runes[(text[i + 1] & 0x03) << 6 | (text[i + 2] & 0x3F)];
+    *n = 3;
+  }
+  return letter == '.' ? 0 : letter;
+}
+
+/* writes text with every Latin letter replaced by its ASCII letter to out and
+ * returns the new length. Runes only shrink, out can be text itself */
+static size_t normalize_text(const char *text, size_t len, char *out) {
+  const unsigned char *bytes = (const unsigned char *)text;
+  size_t j = 0;
+  for (size_t i = 0; i < len;) {
+    size_t n = 1;
+    char letter = bytes[i] >= 0xC3 ? latin_letter(bytes, len, i, &n) : 0;
+    if (letter) {
+      out[j++] = letter;
+      i += n;
+    } else {
+      out[j++] = text[i++];
+    }
+  }
+  return j;
+}
+
+/* normalized copy of input, NULL if normalizing doesn't change it */
+static char *normalized_copy(const char *text, size_t len, size_t *out_len) {
+  size_t i = 0;
+  size_t n;
+  const unsigned char *bytes = (const unsigned char *)text;
+  while (i < len && (bytes[i] < 0xC3 || !latin_letter(bytes, len, i, &n))) {
+    i++;
+  }
+  if (i == len) {
+    return NULL;
+  }
+  char *copy = (char *)malloc(len + 1);
+  memcpy(copy, text, i);
+  *out_len = i + normalize_text(text + i, len - i, copy + i);
+  copy[*out_len] = 0;
+  return copy;
+}
+
+/* maps positions in the normalized text back to the bytes of text, a letter
+ * becomes the first byte of its rune */
+static void denormalize_positions(const char *text, size_t len,
+                                  fzf_position_t *pos) {
+  if (pos == NULL || pos->size == 0) {
+    return;
+  }
+  uint32_t *origin = (uint32_t *)malloc(len * sizeof(uint32_t));
+  const unsigned char *bytes = (const unsigned char *)text;
+  size_t j = 0;
+  for (size_t i = 0; i < len;) {
+    size_t n = 1;
+    if (bytes[i] < 0xC3 || !latin_letter(bytes, len, i, &n)) {
+      n = 1;
+    }
+    origin[j++] = (uint32_t)i;
+    i += n;
+  }
+  for (size_t i = 0; i < pos->size; i++) {
+    pos->data[i] = origin[pos->data[i]];
+  }
+  free(origin);
+}
+
+/* single bytes never change, see normalize_text */
 static char normalize_rune(char r) {
-  // TODO(conni2461)
-  /* if (r < 0x00C0 || r > 0x2184) { */
-  /*   return r; */
-  /* } */
-  /* rune n = normalized[r]; */
-  /* if n > 0 { */
-  /*   return n; */
-  /* } */
   return r;
 }
 
@@ -377,7 +586,8 @@ static bool is_ascii(const char *runes, size_t size) {
 }
 
 static int32_t ascii_fuzzy_index(fzf_string_t *input, const char *pattern,
-                                 size_t size, bool case_sensitive) {
+                                 size_t size, bool case_sensitive,
+                                 fzf_slab_t *slab) {
   if (!is_ascii(pattern, size)) {
     return -1;
   }
@@ -387,6 +597,7 @@ static int32_t ascii_fuzzy_index(fzf_string_t *input, const char *pattern,
   for (size_t pidx = 0; pidx < size; pidx++) {
     idx = try_skip(input, case_sensitive, pattern[pidx], idx);
     if (idx < 0) {
+      STAT_ADD(slab, prefilter_rejects, 1);
       return -1;
     }
     if (pidx == 0 && idx > 0) {
@@ -398,9 +609,29 @@ static int32_t ascii_fuzzy_index(fzf_string_t *input, const char *pattern,
   return first_idx;
 }
 
-static int32_t calculate_score(bool case_sensitive, bool normalize,
-                               fzf_string_t *text, fzf_string_t *pattern,
-                               size_t sidx, size_t eidx, fzf_position_t *pos) {
+/* last occurrence of b at or after from, which must exist */
+static size_t last_index_of(fzf_string_t *input, bool case_sensitive, byte b,
+                            size_t from) {
+  size_t idx = input->size - 1;
+  if (!case_sensitive && b >= 'a' && b <= 'z') {
+    while (idx > from && (byte)input->data[idx] != b &&
+           (byte)input->data[idx] != b - (byte)32) {
+      idx--;
+    }
+    return idx;
+  }
+  while (idx > from && (byte)input->data[idx] != b) {
+    idx--;
+  }
+  return idx;
+}
+
+static always_inline int32_t calculate_score(bool case_sensitive,
+                                             bool normalize,
+                                             fzf_string_t *text,
+                                             fzf_string_t *pattern,
+                                             size_t sidx, size_t eidx,
+                                             fzf_position_t *pos) {
   const size_t M = pattern->size;
 
   size_t pidx = 0;
@@ -462,12 +693,14 @@ static int32_t calculate_score(bool case_sensitive, bool normalize,
 fzf_result_t fzf_fuzzy_match_v1(bool case_sensitive, bool normalize,
                                 fzf_string_t *text, fzf_string_t *pattern,
                                 fzf_position_t *pos, fzf_slab_t *slab) {
+  STAT_ADD(slab, fuzzy_v1_calls, 1);
+  STAT_ADD(slab, bytes_scanned, text->size);
   const size_t M = pattern->size;
   const size_t N = text->size;
   if (M == 0) {
     return (fzf_result_t){0, 0, 0};
   }
-  if (ascii_fuzzy_index(text, pattern->data, M, case_sensitive) < 0) {
+  if (ascii_fuzzy_index(text, pattern->data, M, case_sensitive, slab) < 0) {
     return (fzf_result_t){-1, -1, 0};
   }
 
@@ -521,40 +754,58 @@ fzf_result_t fzf_fuzzy_match_v1(bool case_sensitive, bool normalize,
   return (fzf_result_t){-1, -1, 0};
 }
 
-fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, bool normalize,
-                                fzf_string_t *text, fzf_string_t *pattern,
-                                fzf_position_t *pos, fzf_slab_t *slab) {
+static always_inline fzf_result_t
+fuzzy_match_v2(bool case_sensitive, bool normalize, fzf_string_t *text,
+               fzf_string_t *pattern, fzf_position_t *pos, fzf_slab_t *slab) {
+  STAT_ADD(slab, fuzzy_v2_calls, 1);
   const size_t M = pattern->size;
-  const size_t N = text->size;
   if (M == 0) {
     return (fzf_result_t){0, 0, 0};
   }
-  if (slab != NULL && N * M > slab->I16.cap) {
-    return fzf_fuzzy_match_v1(case_sensitive, normalize, text, pattern, pos,
-                              slab);
-  }
 
   size_t idx;
   {
-    int32_t tmp_idx = ascii_fuzzy_index(text, pattern->data, M, case_sensitive);
+    int32_t tmp_idx =
+        ascii_fuzzy_index(text, pattern->data, M, case_sensitive, slab);
     if (tmp_idx < 0) {
+      STAT_ADD(slab, bytes_scanned, text->size);
       return (fzf_result_t){-1, -1, 0};
     }
     idx = (size_t)tmp_idx;
   }
+  // Nothing after the last occurrence of the last char can be part of a match,
+  // so all buffers only cover the window [idx, idx + W) of the text. Indices
+  // stored in f, last_idx and max_score_pos stay relative to the whole text
+  const size_t W =
+      last_index_of(text, case_sensitive, (byte)pattern->data[M - 1], idx) -
+      idx + 1;
+  if (slab != NULL) {
+    // h0, c0, bo and the two width * M matrices, the window is an upper bound
+    // of the width
+    slab_reserve(slab, (3 + 2 * M) * W, M + W);
+  }
+  if (slab != NULL && W * M > slab->I16.cap) {
+    STAT_ADD(slab, v1_fallbacks, 1);
+    return fzf_fuzzy_match_v1(case_sensitive, normalize, text, pattern, pos,
+                              slab);
+  }
+  STAT_ADD(slab, bytes_scanned, text->size);
 
   size_t offset16 = 0;
   size_t offset32 = 0;
 
-  fzf_i16_t h0 = alloc16(&offset16, slab, N);
-  fzf_i16_t c0 = alloc16(&offset16, slab, N);
+  fzf_i16_t h0 = alloc16(&offset16, slab, W);
+  fzf_i16_t c0 = alloc16(&offset16, slab, W);
   // Bonus point for each positions
-  fzf_i16_t bo = alloc16(&offset16, slab, N);
+  fzf_i16_t bo = alloc16(&offset16, slab, W);
   // The first occurrence of each character in the pattern
   fzf_i32_t f = alloc32(&offset32, slab, M);
   // Rune array
-  fzf_i32_t t = alloc32(&offset32, slab, N);
-  copy_runes(text, &t); // input.CopyRunes(T)
+  fzf_i32_t t = alloc32(&offset32, slab, W);
+  {
+    fzf_string_t window = {.data = text->data + idx, .size = W};
+    copy_runes(&window, &t); // input.CopyRunes(T)
+  }
 
   // Phase 2. Calculate bonus for each point
   int16_t max_score = 0;
@@ -569,13 +820,10 @@ fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, bool normalize,
   int32_t prev_class = CharNonWord;
   bool in_gap = false;
 
-  i32_slice_t t_sub = slice_i32(t.data, idx, t.size); // T[idx:];
-  i16_slice_t h0_sub =
-      slice_i16_right(slice_i16(h0.data, idx, h0.size).data, t_sub.size);
-  i16_slice_t c0_sub =
-      slice_i16_right(slice_i16(c0.data, idx, c0.size).data, t_sub.size);
-  i16_slice_t b_sub =
-      slice_i16_right(slice_i16(bo.data, idx, bo.size).data, t_sub.size);
+  i32_slice_t t_sub = slice_i32(t.data, 0, t.size); // T[idx:];
+  i16_slice_t h0_sub = slice_i16(h0.data, 0, h0.size);
+  i16_slice_t c0_sub = slice_i16(c0.data, 0, c0.size);
+  i16_slice_t b_sub = slice_i16(bo.data, 0, bo.size);
 
   for (size_t off = 0; off < t_sub.size; off++) {
     char_class class;
@@ -649,13 +897,15 @@ fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, bool normalize,
   size_t width = last_idx - f0 + 1;
   fzf_i16_t h = alloc16(&offset16, slab, width * M);
   {
-    i16_slice_t h0_tmp_slice = slice_i16(h0.data, f0, last_idx + 1);
+    i16_slice_t h0_tmp_slice =
+        slice_i16(h0.data, f0 - idx, last_idx + 1 - idx);
     copy_into_i16(&h0_tmp_slice, &h);
   }
 
   fzf_i16_t c = alloc16(&offset16, slab, width * M);
   {
-    i16_slice_t c0_tmp_slice = slice_i16(c0.data, f0, last_idx + 1);
+    i16_slice_t c0_tmp_slice =
+        slice_i16(c0.data, f0 - idx, last_idx + 1 - idx);
     copy_into_i16(&c0_tmp_slice, &c);
   }
 
@@ -668,8 +918,9 @@ fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, bool normalize,
     pidx = off + 1;
     size_t row = pidx * width;
     in_gap = false;
-    t_sub = slice_i32(t.data, foff, last_idx + 1);
-    b_sub = slice_i16_right(slice_i16(bo.data, foff, bo.size).data, t_sub.size);
+    t_sub = slice_i32(t.data, foff - idx, last_idx + 1 - idx);
+    b_sub = slice_i16_right(slice_i16(bo.data, foff - idx, bo.size).data,
+                            t_sub.size);
     i16_slice_t c_sub = slice_i16_right(
         slice_i16(c.data, row + foff - f0, c.size).data, t_sub.size);
     i16_slice_t c_diag = slice_i16_right(
@@ -704,7 +955,7 @@ fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, bool normalize,
           consecutive = 1;
         } else if (consecutive > 1) {
           b = max16(b, max16(BonusConsecutive,
-                             bo.data[col - ((size_t)consecutive) + 1]));
+                             bo.data[col - idx - ((size_t)consecutive) + 1]));
         }
         if (s1 + b < s2) {
           s1 += b_sub.data[j];
@@ -767,9 +1018,12 @@ fzf_result_t fzf_fuzzy_match_v2(bool case_sensitive, bool normalize,
                         (int32_t)max_score};
 }
 
-fzf_result_t fzf_exact_match_naive(bool case_sensitive, bool normalize,
-                                   fzf_string_t *text, fzf_string_t *pattern,
-                                   fzf_position_t *pos, fzf_slab_t *slab) {
+static always_inline fzf_result_t
+exact_match_naive(bool case_sensitive, bool normalize, fzf_string_t *text,
+                  fzf_string_t *pattern, fzf_position_t *pos,
+                  fzf_slab_t *slab) {
+  STAT_ADD(slab, exact_calls, 1);
+  STAT_ADD(slab, bytes_scanned, text->size);
   const size_t M = pattern->size;
   const size_t N = text->size;
 
@@ -779,7 +1033,7 @@ fzf_result_t fzf_exact_match_naive(bool case_sensitive, bool normalize,
   if (N < M) {
     return (fzf_result_t){-1, -1, 0};
   }
-  if (ascii_fuzzy_index(text, pattern->data, M, case_sensitive) < 0) {
+  if (ascii_fuzzy_index(text, pattern->data, M, case_sensitive, slab) < 0) {
     return (fzf_result_t){-1, -1, 0};
   }
 
@@ -831,9 +1085,11 @@ fzf_result_t fzf_exact_match_naive(bool case_sensitive, bool normalize,
   return (fzf_result_t){-1, -1, 0};
 }
 
-fzf_result_t fzf_prefix_match(bool case_sensitive, bool normalize,
-                              fzf_string_t *text, fzf_string_t *pattern,
-                              fzf_position_t *pos, fzf_slab_t *slab) {
+static always_inline fzf_result_t
+prefix_match(bool case_sensitive, bool normalize, fzf_string_t *text,
+             fzf_string_t *pattern, fzf_position_t *pos, fzf_slab_t *slab) {
+  STAT_ADD(slab, prefix_calls, 1);
+  STAT_ADD(slab, bytes_scanned, text->size);
   const size_t M = pattern->size;
   if (M == 0) {
     return (fzf_result_t){0, 0, 0};
@@ -866,9 +1122,11 @@ fzf_result_t fzf_prefix_match(bool case_sensitive, bool normalize,
   return (fzf_result_t){(int32_t)start, (int32_t)end, score};
 }
 
-fzf_result_t fzf_suffix_match(bool case_sensitive, bool normalize,
-                              fzf_string_t *text, fzf_string_t *pattern,
-                              fzf_position_t *pos, fzf_slab_t *slab) {
+static always_inline fzf_result_t
+suffix_match(bool case_sensitive, bool normalize, fzf_string_t *text,
+             fzf_string_t *pattern, fzf_position_t *pos, fzf_slab_t *slab) {
+  STAT_ADD(slab, suffix_calls, 1);
+  STAT_ADD(slab, bytes_scanned, text->size);
   size_t trimmed_len = text->size;
   const size_t M = pattern->size;
   /* TODO(conni2461): i think this is wrong */
@@ -903,9 +1161,11 @@ fzf_result_t fzf_suffix_match(bool case_sensitive, bool normalize,
   return (fzf_result_t){(int32_t)start, (int32_t)end, score};
 }
 
-fzf_result_t fzf_equal_match(bool case_sensitive, bool normalize,
-                             fzf_string_t *text, fzf_string_t *pattern,
-                             fzf_position_t *pos, fzf_slab_t *slab) {
+static always_inline fzf_result_t
+equal_match(bool case_sensitive, bool normalize, fzf_string_t *text,
+            fzf_string_t *pattern, fzf_position_t *pos, fzf_slab_t *slab) {
+  STAT_ADD(slab, equal_calls, 1);
+  STAT_ADD(slab, bytes_scanned, text->size);
   const size_t M = pattern->size;
   if (M == 0) {
     return (fzf_result_t){-1, -1, 0};
@@ -956,6 +1216,59 @@ fzf_result_t fzf_equal_match(bool case_sensitive, bool normalize,
   return (fzf_result_t){-1, -1, 0};
 }
 
+/* Specialized matchers
+ *
+ * Case sensitivity is fixed for a term and whether positions are wanted for a
+ * call, yet the matchers test both for every byte. Each matcher body is
+ * inlined into the public function with its flags as given and into one
+ * instance per case with constant flags, which inlines it again for pos and
+ * pos == NULL, so the compiler drops the branches from the inner loops. Terms
+ * call the instance of their case, see specialize. Text is normalized before
+ * matching, so the instances run with normalize false and, being bound to
+ * both flags, don't take them as parameters. */
+#define gen_matcher(name, body, case_sensitive)                                \
+  static fzf_result_t name(fzf_string_t *text, fzf_string_t *pattern,          \
+                           fzf_position_t *pos, fzf_slab_t *slab) {            \
+    if (pos == NULL) {                                                         \
+      return body(case_sensitive, false, text, pattern, NULL, slab);           \
+    }                                                                          \
+    return body(case_sensitive, false, text, pattern, pos, slab);              \
+  }
+
+#define gen_matchers(name)                                                     \
+  fzf_result_t fzf_##name(bool case_sensitive, bool normalize,                 \
+                          fzf_string_t *text, fzf_string_t *pattern,           \
+                          fzf_position_t *pos, fzf_slab_t *slab) {             \
+    return name(case_sensitive, normalize, text, pattern, pos, slab);          \
+  }                                                                            \
+  gen_matcher(name##_ci, name, false);                                         \
+  gen_matcher(name##_cs, name, true)
+
+gen_matchers(fuzzy_match_v2);
+gen_matchers(exact_match_naive);
+gen_matchers(prefix_match);
+gen_matchers(suffix_match);
+gen_matchers(equal_match);
+#undef gen_matchers
+#undef gen_matcher
+
+/* the instance of fn for a case, parse_pattern only uses these algorithms */
+static fzf_matcher_t specialize(fzf_algo_t fn, bool case_sensitive) {
+  if (fn == fzf_fuzzy_match_v2) {
+    return case_sensitive ? fuzzy_match_v2_cs : fuzzy_match_v2_ci;
+  }
+  if (fn == fzf_exact_match_naive) {
+    return case_sensitive ? exact_match_naive_cs : exact_match_naive_ci;
+  }
+  if (fn == fzf_prefix_match) {
+    return case_sensitive ? prefix_match_cs : prefix_match_ci;
+  }
+  if (fn == fzf_suffix_match) {
+    return case_sensitive ? suffix_match_cs : suffix_match_ci;
+  }
+  return case_sensitive ? equal_match_cs : equal_match_ci;
+}
+
 static void append_set(fzf_term_set_t *set, fzf_term_t value) {
   if (set->cap == 0) {
     set->cap = 1;
@@ -981,19 +1294,19 @@ static void append_pattern(fzf_pattern_t *pattern, fzf_term_set_t *value) {
   pattern->size++;
 }
 
-#define CALL_ALG(term, normalize, input, pos, slab)                            \
-  term->fn((term)->case_sensitive, normalize, &(input),                        \
-           (fzf_string_t *)(term)->text, pos, slab)
+#define CALL_ALG(term, input, pos, slab)                                       \
+  (term)->match(&(input), (fzf_string_t *)(term)->text, pos, slab)
 
 // TODO(conni2461): REFACTOR
 /* assumption (maybe i change that later)
  * - always v2 alg
  * - bool extended always true (thats the whole point of this isn't it)
  */
-fzf_pattern_t *fzf_parse_pattern(fzf_case_types case_mode, bool normalize,
-                                 char *pattern, bool fuzzy) {
+static fzf_pattern_t *parse_pattern(fzf_case_types case_mode, bool normalize,
+                                    char *pattern, bool fuzzy) {
   fzf_pattern_t *pat_obj = (fzf_pattern_t *)malloc(sizeof(fzf_pattern_t));
   memset(pat_obj, 0, sizeof(*pat_obj));
+  pat_obj->normalize = normalize;
 
   size_t pat_len = strlen(pattern);
   if (pat_len == 0) {
@@ -1022,6 +1335,10 @@ fzf_pattern_t *fzf_parse_pattern(fzf_case_types case_mode, bool normalize,
     size_t len = strlen(ptr);
     str_replace_char(ptr, '\t', ' ');
     char *text = strdup(ptr);
+    if (normalize) {
+      len = normalize_text(text, len, text);
+      text[len] = 0;
+    }
 
     char *og_str = text;
     char *lower_text = str_tolower(text, len);
@@ -1093,7 +1410,9 @@ fzf_pattern_t *fzf_parse_pattern(fzf_case_types case_mode, bool normalize,
                                    .inv = inv,
                                    .ptr = og_str,
                                    .text = text_ptr,
-                                   .case_sensitive = case_sensitive});
+                                   .case_sensitive = case_sensitive,
+                                   .mask = fzf_char_mask(text, len),
+                                   .match = specialize(fn, case_sensitive)});
       switch_set = true;
     } else {
       SFREE(og_str);
@@ -1141,22 +1460,234 @@ void fzf_free_pattern(fzf_pattern_t *pattern) {
   SFREE(pattern);
 }
 
-int32_t fzf_get_score(const char *text, fzf_pattern_t *pattern,
-                      fzf_slab_t *slab) {
-  // If the pattern is an empty string then pattern->ptr will be NULL and we
-  // basically don't want to filter. Return 1 for telescope
-  if (pattern->ptr == NULL) {
-    return 1;
+/* Fields (--nth) */
+static bool is_blank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+/* end of the field starting at pos. A field includes the delimiter ending it,
+ * without a delimiter fields are split like awk does and the whitespace after
+ * a field belongs to it */
+static size_t field_end(fzf_string_t *input, size_t pos, char delimiter) {
+  const char *text = input->data;
+  size_t len = input->size;
+  if (delimiter) {
+    const char *d = (const char *)memchr(text + pos, delimiter, len - pos);
+    return d ? (size_t)(d - text) + 1 : len;
+  }
+  while (pos < len && is_blank(text[pos])) {
+    pos++;
+  }
+  while (pos < len && !is_blank(text[pos])) {
+    pos++;
+  }
+  while (pos < len && is_blank(text[pos])) {
+    pos++;
   }
+  return pos;
+}
 
-  fzf_string_t input = {.data = text, .size = strlen(text)};
+static int64_t resolve_field(int32_t idx, size_t count, int64_t open) {
+  if (idx == 0) {
+    return open;
+  }
+  return idx < 0 ? (int64_t)count + idx + 1 : idx;
+}
+
+typedef struct {
+  size_t begin;
+  size_t end;
+} span_t;
+
+// no result for the item, it is matched as usual
+#define SCORE_UNKNOWN INT32_MIN
+
+/* results of a term for every item of a corpus, -1 if it doesn't match */
+typedef struct {
+  fzf_term_t *term;
+  int32_t *scores;
+} known_term_t;
+
+#define KNOWN_MAX_TERMS 8
+
+typedef struct {
+  known_term_t terms[KNOWN_MAX_TERMS];
+  size_t size;
+} known_scores_t;
+
+/* the parts of an item the terms are matched against */
+typedef struct {
+  size_t basename;
+  bool fields;
+  size_t size;
+  span_t spans[FZF_MAX_NTH];
+  /* results matched ahead of time for item, see trie_match */
+  const known_scores_t *known;
+  size_t item;
+} item_view_t;
+
+static void resolve_view(fzf_pattern_t *pattern, fzf_string_t *input,
+                         size_t basename, item_view_t *view) {
+  view->basename = basename;
+  view->fields = pattern->nth_size > 0;
+  view->size = 0;
+  view->known = NULL;
+  if (!view->fields) {
+    return;
+  }
+  size_t count = 0;
+  for (size_t pos = 0; pos < input->size;
+       pos = field_end(input, pos, pattern->delimiter)) {
+    count++;
+  }
+  for (size_t i = 0; i < pattern->nth_size; i++) {
+    int64_t begin = resolve_field(pattern->nth[i].begin, count, 1);
+    int64_t end = resolve_field(pattern->nth[i].end, count, (int64_t)count);
+    begin = begin < 1 ? 1 : begin;
+    end = end > (int64_t)count ? (int64_t)count : end;
+    if (begin > end) {
+      continue;
+    }
+    span_t span = {0, 0};
+    size_t pos = 0;
+    for (int64_t field = 1; field <= end; field++) {
+      if (field == begin) {
+        span.begin = pos;
+      }
+      pos = field_end(input, pos, pattern->delimiter);
+    }
+    span.end = pos;
+    view->spans[view->size++] = span;
+  }
+}
+
+static fzf_result_t match_slice(fzf_term_t *term, fzf_string_t *input,
+                                span_t span, fzf_position_t *pos,
+                                fzf_slab_t *slab) {
+  fzf_string_t slice = {.data = input->data + span.begin,
+                        .size = span.end - span.begin};
+  size_t before = pos ? pos->size : 0;
+  fzf_result_t res = CALL_ALG(term, slice, pos, slab);
+  if (res.start >= 0) {
+    res.start += (int32_t)span.begin;
+    res.end += (int32_t)span.begin;
+    for (size_t i = before; pos && i < pos->size; i++) {
+      pos->data[i] += (uint32_t)span.begin;
+    }
+  } else if (pos) {
+    pos->size = before;
+  }
+  return res;
+}
+
+/* with fields every selected field is matched on its own and the best one
+ * wins. Otherwise, with basename > 0, fuzzy and exact terms are matched
+ * against the file name first and only fall back to the whole path if it
+ * doesn't contain them */
+static fzf_result_t match_term(fzf_term_t *term, fzf_string_t *input,
+                               item_view_t *view, fzf_position_t *pos,
+                               fzf_slab_t *slab) {
+  for (size_t i = 0; pos == NULL && view->known && i < view->known->size;
+       i++) {
+    const known_term_t *known = &view->known->terms[i];
+    int32_t score = known->term == term ? known->scores[view->item]
+                                        : SCORE_UNKNOWN;
+    if (score >= 0) {
+      return (fzf_result_t){0, 0, score};
+    } else if (score != SCORE_UNKNOWN) {
+      return (fzf_result_t){-1, -1, 0};
+    }
+  }
+  if (view->fields) {
+    fzf_result_t best = {-1, -1, 0};
+    size_t best_span = 0;
+    for (size_t i = 0; i < view->size; i++) {
+      fzf_result_t res = match_slice(term, input, view->spans[i], NULL, slab);
+      if (res.start >= 0 && (best.start < 0 || res.score > best.score)) {
+        best = res;
+        best_span = i;
+      }
+    }
+    if (pos && best.start >= 0) {
+      best = match_slice(term, input, view->spans[best_span], pos, slab);
+    }
+    return best;
+  }
+  size_t basename = view->basename;
+  if (basename > 0 && basename < input->size && !term->inv &&
+      (term->fn == fzf_fuzzy_match_v2 || term->fn == fzf_exact_match_naive)) {
+    span_t name = {basename, input->size};
+    fzf_result_t res = match_slice(term, input, name, pos, slab);
+    if (res.start >= 0) {
+      return res;
+    }
+  }
+  return CALL_ALG(term, *input, pos, slab);
+}
+
+static bool parse_field_index(const char **nth, int32_t *out) {
+  char *end = NULL;
+  long idx = strtol(*nth, &end, 10);
+  if (end == *nth) {
+    return false;
+  }
+  *nth = end;
+  *out = (int32_t)idx;
+  return idx != 0;
+}
+
+static bool parse_field_range(const char **nth, fzf_field_range_t *range) {
+  range->begin = 0;
+  range->end = 0;
+  bool has_begin = **nth != '.';
+  if (has_begin && !parse_field_index(nth, &range->begin)) {
+    return false;
+  }
+  if (strncmp(*nth, "..", 2) != 0) {
+    range->end = range->begin;
+    return has_begin;
+  }
+  *nth += 2;
+  if (**nth != ',' && **nth != '\0') {
+    return parse_field_index(nth, &range->end);
+  }
+  return true;
+}
+
+static uint64_t next_pattern_id(void);
+
+bool fzf_pattern_set_nth(fzf_pattern_t *pattern, char delimiter,
+                         const char *nth) {
+  pattern->id = next_pattern_id();
+  pattern->delimiter = delimiter;
+  pattern->nth_size = 0;
+  if (nth == NULL) {
+    return true;
+  }
+  while (*nth) {
+    fzf_field_range_t range;
+    if (pattern->nth_size == FZF_MAX_NTH || !parse_field_range(&nth, &range) ||
+        (*nth != ',' && *nth != '\0')) {
+      pattern->nth_size = 0;
+      return false;
+    }
+    pattern->nth[pattern->nth_size++] = range;
+    if (*nth == ',') {
+      nth++;
+    }
+  }
+  return true;
+}
+
+static int32_t score_view(fzf_string_t *input, item_view_t *view,
+                          fzf_pattern_t *pattern, fzf_slab_t *slab) {
   if (pattern->only_inv) {
     int final = 0;
     for (size_t i = 0; i < pattern->size; i++) {
       fzf_term_set_t *term_set = pattern->ptr[i];
       fzf_term_t *term = &term_set->ptr[0];
 
-      final += CALL_ALG(term, false, input, NULL, slab).score;
+      final += match_term(term, input, view, NULL, slab).score;
     }
     return (final > 0) ? 0 : 1;
   }
@@ -1168,7 +1699,7 @@ int32_t fzf_get_score(const char *text, fzf_pattern_t *pattern,
     bool matched = false;
     for (size_t j = 0; j < term_set->size; j++) {
       fzf_term_t *term = &term_set->ptr[j];
-      fzf_result_t res = CALL_ALG(term, false, input, NULL, slab);
+      fzf_result_t res = match_term(term, input, view, NULL, slab);
       if (res.start >= 0) {
         if (term->inv) {
           continue;
@@ -1194,16 +1725,28 @@ int32_t fzf_get_score(const char *text, fzf_pattern_t *pattern,
   return total_score;
 }
 
-fzf_position_t *fzf_get_positions(const char *text, fzf_pattern_t *pattern,
-                                  fzf_slab_t *slab) {
+static int32_t get_score(fzf_string_t *input, size_t basename,
+                         fzf_pattern_t *pattern, fzf_slab_t *slab) {
   // If the pattern is an empty string then pattern->ptr will be NULL and we
   // basically don't want to filter. Return 1 for telescope
   if (pattern->ptr == NULL) {
-    return NULL;
+    return 1;
   }
 
-  fzf_string_t input = {.data = text, .size = strlen(text)};
-  fzf_position_t *all_pos = fzf_pos_array(0);
+  item_view_t view;
+  resolve_view(pattern, input, basename, &view);
+  return score_view(input, &view, pattern, slab);
+}
+
+/* appends the positions of a match to pos and sums up the same score as
+ * get_score, false if the item doesn't match */
+static bool match_item(fzf_string_t *input, size_t basename,
+                       fzf_pattern_t *pattern, fzf_position_t *pos,
+                       fzf_slab_t *slab, int32_t *score) {
+  item_view_t view;
+  resolve_view(pattern, input, basename, &view);
+  int32_t total_score = 0;
+  *score = 0;
   for (size_t i = 0; i < pattern->size; i++) {
     fzf_term_set_t *term_set = pattern->ptr[i];
     bool matched = false;
@@ -1213,26 +1756,308 @@ fzf_position_t *fzf_get_positions(const char *text, fzf_pattern_t *pattern,
         // If we have an inverse term we need to check if we have a match, but
         // we are not interested in the positions (for highlights) so to speed
         // this up we can pass in NULL here and don't calculate the positions
-        fzf_result_t res = CALL_ALG(term, false, input, NULL, slab);
+        fzf_result_t res = match_term(term, input, &view, NULL, slab);
         if (res.start < 0) {
           matched = true;
         }
         continue;
       }
-      fzf_result_t res = CALL_ALG(term, false, input, all_pos, slab);
+      fzf_result_t res = match_term(term, input, &view, pos, slab);
       if (res.start >= 0) {
+        total_score += res.score;
         matched = true;
         break;
       }
     }
     if (!matched) {
-      fzf_free_positions(all_pos);
-      return NULL;
+      return false;
     }
   }
+  *score = pattern->only_inv ? 1 : total_score;
+  return true;
+}
+
+static fzf_position_t *get_positions(fzf_string_t *input, size_t basename,
+                                     fzf_pattern_t *pattern,
+                                     fzf_slab_t *slab) {
+  // If the pattern is an empty string then pattern->ptr will be NULL and we
+  // basically don't want to filter. Return 1 for telescope
+  if (pattern->ptr == NULL) {
+    return NULL;
+  }
+
+  fzf_position_t *all_pos = fzf_pos_array(0);
+  int32_t score;
+  if (!match_item(input, basename, pattern, all_pos, slab, &score)) {
+    fzf_free_positions(all_pos);
+    return NULL;
+  }
   return all_pos;
 }
 
+/* Timing and tracing */
+#ifdef _WIN32
+static uint64_t now_ns(void) {
+  LARGE_INTEGER freq;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+#else
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#ifdef _MSC_VER
+#define atomic_add64(ptr, val)                                                 \
+  _InterlockedExchangeAdd64((volatile __int64 *)(ptr), (__int64)(val))
+#define atomic_cas64(ptr, expected, desired)                                   \
+  (_InterlockedCompareExchange64((volatile __int64 *)(ptr),                    \
+                                 (__int64)(desired), (__int64)(expected)) ==   \
+   (__int64)(expected))
+#define atomic_load64(ptr) _InterlockedOr64((volatile __int64 *)(ptr), 0)
+#define atomic_store64(ptr, val)                                               \
+  _InterlockedExchange64((volatile __int64 *)(ptr), (__int64)(val))
+#define atomic_dec64(ptr) _InterlockedDecrement64((volatile __int64 *)(ptr))
+#define atomic_loadptr(ptr)                                                    \
+  _InterlockedCompareExchangePointer((void *volatile *)(ptr), NULL, NULL)
+#define atomic_storeptr(ptr, val)                                              \
+  _InterlockedExchangePointer((void *volatile *)(ptr), (void *)(val))
+#else
+#define atomic_add64(ptr, val) __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED)
+#define atomic_load64(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomic_store64(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define atomic_dec64(ptr) __atomic_sub_fetch(ptr, 1, __ATOMIC_ACQ_REL)
+#define atomic_loadptr(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define atomic_storeptr(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define atomic_cas64(ptr, expected, desired)                                   \
+  __atomic_compare_exchange_n(ptr, &(expected), desired, false,                \
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#endif
+
+#ifdef FZF_USDT
+#define usdt_probe(probe, name, text, value)                                   \
+  switch (probe) {                                                             \
+  case ProbeParsePattern:                                                      \
+    DTRACE_PROBE2(fzf, parse_pattern_##name, text, value);                     \
+    break;                                                                     \
+  case ProbeGetScore:                                                          \
+    DTRACE_PROBE2(fzf, get_score_##name, text, value);                         \
+    break;                                                                     \
+  default:                                                                     \
+    DTRACE_PROBE2(fzf, get_positions_##name, text, value);                     \
+    break;                                                                     \
+  }
+#else
+#define usdt_probe(probe, name, text, value)
+#endif
+
+/* toggled by the caller while scheduler threads run probes, so all of these
+ * go through the atomic helpers. Timing and tracing are bits of one word, so
+ * switching one of them never loses the other */
+#define PROBE_TIMING 1
+#define PROBE_TRACE 2
+static uint64_t probes_active = 0;
+static fzf_trace_fn trace_fn = NULL;
+static void *trace_data = NULL;
+static fzf_histogram_t histograms[ProbeLast];
+
+static size_t histogram_bucket(uint64_t ns) {
+  size_t bucket = 0;
+  while (ns > 1 && bucket < FZF_HIST_BUCKETS - 1) {
+    ns >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void histogram_record(fzf_histogram_t *hist, uint64_t ns) {
+  atomic_add64(&hist->buckets[histogram_bucket(ns)], 1);
+  atomic_add64(&hist->count, 1);
+  atomic_add64(&hist->total_ns, ns);
+  uint64_t max = hist->max_ns;
+  while (ns > max && !atomic_cas64(&hist->max_ns, max, ns)) {
+    max = hist->max_ns;
+  }
+}
+
+static void probes_update(uint64_t bit, bool on) {
+  uint64_t old;
+  uint64_t val;
+  do {
+    old = atomic_load64(&probes_active);
+    val = on ? old | bit : old & ~bit;
+  } while (!atomic_cas64(&probes_active, old, val));
+}
+
+static void trace_call(fzf_probe_types probe, bool enter, const char *text,
+                       uint64_t elapsed) {
+  fzf_trace_fn fn = (fzf_trace_fn)atomic_loadptr(&trace_fn);
+  if (fn) {
+    fn(atomic_loadptr(&trace_data), probe, enter, text, elapsed);
+  }
+}
+
+/* returns 0 if nothing listens, which probe_exit takes as "do not record" */
+static uint64_t probe_enter(fzf_probe_types probe, const char *text) {
+  usdt_probe(probe, entry, text, 0);
+  if (!atomic_load64(&probes_active)) {
+    return 0;
+  }
+  trace_call(probe, true, text, 0);
+  return now_ns();
+}
+
+/* value is what the usdt return probe reports: the score for
+ * ProbeGetScore, the number of positions for ProbeGetPositions and the
+ * number of term sets for ProbeParsePattern */
+static void probe_exit(fzf_probe_types probe, const char *text, uint64_t start,
+                       int64_t value) {
+  usdt_probe(probe, return, text, value);
+  (void)value;
+  if (start == 0) {
+    return;
+  }
+  uint64_t elapsed = now_ns() - start;
+  if (atomic_load64(&probes_active) & PROBE_TIMING) {
+    histogram_record(&histograms[probe], elapsed);
+  }
+  trace_call(probe, false, text, elapsed);
+}
+
+static uint64_t pattern_ids = 0;
+
+static uint64_t next_pattern_id(void) {
+  return atomic_add64(&pattern_ids, 1) + 1;
+}
+
+/* points input to a normalized copy if the pattern normalizes and the text
+ * changes. Returns the copy for the caller to free */
+static char *normalize_input(fzf_pattern_t *pattern, fzf_string_t *input) {
+  if (!pattern->normalize) {
+    return NULL;
+  }
+  size_t len;
+  char *copy = normalized_copy(input->data, input->size, &len);
+  if (copy) {
+    input->data = copy;
+    input->size = len;
+  }
+  return copy;
+}
+
+size_t fzf_normalize_text(const char *text, size_t len, char *out) {
+  return normalize_text(text, len, out);
+}
+
+void fzf_denormalize_positions(const char *text, size_t len,
+                               fzf_position_t *pos) {
+  denormalize_positions(text, len, pos);
+}
+
+fzf_pattern_t *fzf_parse_pattern(fzf_case_types case_mode, bool normalize,
+                                 char *pattern, bool fuzzy) {
+  uint64_t start = probe_enter(ProbeParsePattern, pattern);
+  fzf_pattern_t *res = parse_pattern(case_mode, normalize, pattern, fuzzy);
+  res->id = next_pattern_id();
+  probe_exit(ProbeParsePattern, pattern, start, (int64_t)res->size);
+  return res;
+}
+
+int32_t fzf_get_score(const char *text, fzf_pattern_t *pattern,
+                      fzf_slab_t *slab) {
+  uint64_t start = probe_enter(ProbeGetScore, text);
+  fzf_string_t input = {.data = text, .size = strlen(text)};
+  char *normalized = normalize_input(pattern, &input);
+  int32_t res = get_score(&input, 0, pattern, slab);
+  free(normalized);
+  probe_exit(ProbeGetScore, text, start, res);
+  return res;
+}
+
+fzf_position_t *fzf_get_positions(const char *text, fzf_pattern_t *pattern,
+                                  fzf_slab_t *slab) {
+  uint64_t start = probe_enter(ProbeGetPositions, text);
+  fzf_string_t input = {.data = text, .size = strlen(text)};
+  char *normalized = normalize_input(pattern, &input);
+  fzf_position_t *res = get_positions(&input, 0, pattern, slab);
+  if (normalized) {
+    denormalize_positions(text, strlen(text), res);
+    free(normalized);
+  }
+  probe_exit(ProbeGetPositions, text, start, res ? (int64_t)res->size : 0);
+  return res;
+}
+
+fzf_position_t *fzf_get_match(const char *text, fzf_pattern_t *pattern,
+                              fzf_slab_t *slab, int32_t *score) {
+  if (pattern->ptr == NULL) {
+    *score = 1;
+    return NULL;
+  }
+  uint64_t start = probe_enter(ProbeGetPositions, text);
+  fzf_string_t input = {.data = text, .size = strlen(text)};
+  char *normalized = normalize_input(pattern, &input);
+  fzf_position_t *pos = fzf_pos_array(0);
+  if (!match_item(&input, 0, pattern, pos, slab, score)) {
+    fzf_free_positions(pos);
+    pos = NULL;
+  }
+  if (normalized) {
+    denormalize_positions(text, strlen(text), pos);
+    free(normalized);
+  }
+  probe_exit(ProbeGetPositions, text, start, pos ? (int64_t)pos->size : 0);
+  return pos;
+}
+
+void fzf_enable_timing(void) {
+  probes_update(PROBE_TIMING, true);
+}
+
+void fzf_disable_timing(void) {
+  probes_update(PROBE_TIMING, false);
+}
+
+void fzf_reset_timing(void) {
+  memset(histograms, 0, sizeof(histograms));
+}
+
+void fzf_get_timing(fzf_probe_types probe, fzf_histogram_t *out) {
+  memcpy(out, &histograms[probe], sizeof(*out));
+}
+
+uint64_t fzf_histogram_percentile(const fzf_histogram_t *hist, double p) {
+  if (hist->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(p * (double)hist->count);
+  if (rank >= hist->count) {
+    rank = hist->count - 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < FZF_HIST_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen > rank) {
+      // upper bound of the bucket, but never more than what we have seen
+      uint64_t upper = i >= 63 ? UINT64_MAX : ((uint64_t)2 << i) - 1;
+      return upper < hist->max_ns ? upper : hist->max_ns;
+    }
+  }
+  return hist->max_ns;
+}
+
+void fzf_set_trace_hook(fzf_trace_fn fn, void *data) {
+  // data first, so a probe that sees the new fn also sees its data
+  atomic_storeptr(&trace_data, data);
+  atomic_storeptr(&trace_fn, fn);
+  probes_update(PROBE_TRACE, fn != NULL);
+}
+
 void fzf_free_positions(fzf_position_t *pos) {
   if (pos) {
     SFREE(pos->data);
@@ -1243,15 +2068,16 @@ void fzf_free_positions(fzf_position_t *pos) {
 fzf_slab_t *fzf_make_slab(fzf_slab_config_t config) {
   fzf_slab_t *slab = (fzf_slab_t *)malloc(sizeof(fzf_slab_t));
   memset(slab, 0, sizeof(*slab));
+  slab->config = config;
 
-  slab->I16.data = (int16_t *)malloc(config.size_16 * sizeof(int16_t));
-  memset(slab->I16.data, 0, config.size_16 * sizeof(*slab->I16.data));
+  slab->I16.data = (int16_t *)slab_buffer(config.size_16 * sizeof(int16_t),
+                                          config.huge_pages);
   slab->I16.cap = config.size_16;
   slab->I16.size = 0;
   slab->I16.allocated = true;
 
-  slab->I32.data = (int32_t *)malloc(config.size_32 * sizeof(int32_t));
-  memset(slab->I32.data, 0, config.size_32 * sizeof(*slab->I32.data));
+  slab->I32.data = (int32_t *)slab_buffer(config.size_32 * sizeof(int32_t),
+                                          config.huge_pages);
   slab->I32.cap = config.size_32;
   slab->I32.size = 0;
   slab->I32.allocated = true;
@@ -1260,13 +2086,2844 @@ fzf_slab_t *fzf_make_slab(fzf_slab_config_t config) {
 }
 
 fzf_slab_t *fzf_make_default_slab(void) {
-  return fzf_make_slab((fzf_slab_config_t){(size_t)100 * 1024, 2048});
+  return fzf_make_slab(default_slab_config);
 }
 
 void fzf_free_slab(fzf_slab_t *slab) {
   if (slab) {
-    free(slab->I16.data);
-    free(slab->I32.data);
+    free_slab_buffer(slab->I16.data);
+    free_slab_buffer(slab->I32.data);
+    SFREE(slab->stats);
     free(slab);
   }
 }
+
+void fzf_enable_stats(fzf_slab_t *slab) {
+#ifndef FZF_NO_STATS
+  if (slab->stats == NULL) {
+    slab->stats = (fzf_stats_t *)malloc(sizeof(fzf_stats_t));
+    memset(slab->stats, 0, sizeof(*slab->stats));
+  }
+#endif
+}
+
+void fzf_disable_stats(fzf_slab_t *slab) {
+  SFREE(slab->stats);
+  slab->stats = NULL;
+}
+
+void fzf_reset_stats(fzf_slab_t *slab) {
+  if (slab->stats) {
+    memset(slab->stats, 0, sizeof(*slab->stats));
+  }
+}
+
+const fzf_stats_t *fzf_get_stats(fzf_slab_t *slab) {
+  return slab->stats;
+}
+
+/* Corpus */
+fzf_corpus_t *fzf_make_corpus(void) {
+  fzf_corpus_t *corpus = (fzf_corpus_t *)malloc(sizeof(fzf_corpus_t));
+  memset(corpus, 0, sizeof(*corpus));
+  return corpus;
+}
+
+static void unmap_file(char *data, size_t size);
+
+static void free_normalized(fzf_normalized_t *norm) {
+  if (norm) {
+    free(norm->data);
+    free(norm->slots);
+    free(norm->offsets);
+    free(norm->lens);
+    free(norm->masks);
+    free(norm);
+  }
+}
+
+static void free_trie(fzf_trie_t *trie) {
+  if (trie) {
+    free(trie->order);
+    free(trie->shared);
+    free(trie);
+  }
+}
+
+void fzf_free_corpus(fzf_corpus_t *corpus) {
+  if (corpus) {
+    if (corpus->map) {
+      unmap_file(corpus->map, corpus->map_size);
+    } else {
+      SFREE(corpus->data);
+    }
+    if (!corpus->mapped_tables) {
+      SFREE(corpus->offsets);
+      SFREE(corpus->lens);
+      SFREE(corpus->masks);
+    }
+    SFREE(corpus->basenames);
+    free_normalized(corpus->normalized);
+    free_trie(corpus->trie);
+    if (corpus->dedup) {
+      SFREE(corpus->dedup->table);
+      SFREE(corpus->dedup->origins);
+      SFREE(corpus->dedup->fanout_offsets);
+      SFREE(corpus->dedup->fanout);
+      free(corpus->dedup);
+    }
+    free(corpus);
+  }
+}
+
+// a-z and 0-9 get a bit each, every other byte shares the remaining 28 bits
+static uint64_t mask_bit(unsigned char c) {
+  if (c >= 'A' && c <= 'Z') {
+    c += 'a' - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return 1ULL << (c - 'a');
+  }
+  if (c >= '0' && c <= '9') {
+    return 1ULL << (26 + c - '0');
+  }
+  return 1ULL << (36 + c % 28);
+}
+
+uint64_t fzf_char_mask(const char *text, size_t len) {
+  uint64_t mask = 0;
+  for (size_t i = 0; i < len; i++) {
+    mask |= mask_bit((unsigned char)text[i]);
+  }
+  return mask;
+}
+
+static void *dup_table(const void *src, size_t size, size_t cap) {
+  void *table = malloc(cap);
+  memcpy(table, src, size);
+  return table;
+}
+
+/* mapped memory is read only, move everything into our own buffers before
+ * appending */
+static void corpus_unmap(fzf_corpus_t *corpus, size_t add_len) {
+  if (corpus->mapped_tables) {
+    size_t count = corpus->count;
+    corpus->items_cap = count + 256;
+    corpus->offsets =
+        (size_t *)dup_table(corpus->offsets, count * sizeof(size_t),
+                            corpus->items_cap * sizeof(size_t));
+    corpus->lens =
+        (uint32_t *)dup_table(corpus->lens, count * sizeof(uint32_t),
+                              corpus->items_cap * sizeof(uint32_t));
+    corpus->masks =
+        (uint64_t *)dup_table(corpus->masks, count * sizeof(uint64_t),
+                              corpus->items_cap * sizeof(uint64_t));
+    corpus->mapped_tables = false;
+    if (corpus->basenames) {
+      corpus->basenames = (uint32_t *)realloc(
+          corpus->basenames, corpus->items_cap * sizeof(uint32_t));
+    }
+  }
+  corpus->data = (char *)dup_table(corpus->data, corpus->size,
+                                   corpus->size + add_len + 1);
+  corpus->cap = corpus->size + add_len + 1;
+  unmap_file(corpus->map, corpus->map_size);
+  corpus->map = NULL;
+  corpus->map_size = 0;
+}
+
+static bool is_separator(char c) {
+#ifdef _WIN32
+  return c == '/' || c == '\\';
+#else
+  return c == '/';
+#endif
+}
+
+static uint32_t basename_of(const char *path, size_t len) {
+  for (size_t i = len; i > 0; i--) {
+    if (is_separator(path[i - 1])) {
+      return (uint32_t)i;
+    }
+  }
+  return 0;
+}
+
+/* normalizes straight into the buffer and only keeps the copy if it is
+ * shorter, every normalized rune loses at least one byte */
+static void normalize_item(fzf_corpus_t *corpus, size_t idx) {
+  fzf_normalized_t *norm = corpus->normalized;
+  if (idx + 1 > norm->slots_cap) {
+    norm->slots_cap = norm->slots_cap == 0 ? 256 : norm->slots_cap * 2;
+    norm->slots_cap = idx + 1 > norm->slots_cap ? idx + 1 : norm->slots_cap;
+    norm->slots =
+        (uint32_t *)realloc(norm->slots, norm->slots_cap * sizeof(uint32_t));
+  }
+  norm->slots[idx] = 0;
+  size_t len = corpus->lens[idx];
+  if (norm->size + len > norm->cap) {
+    norm->cap = norm->cap == 0 ? 4096 : norm->cap * 2;
+    norm->cap = norm->size + len > norm->cap ? norm->size + len : norm->cap;
+    norm->data = (char *)realloc(norm->data, norm->cap);
+  }
+  char *out = norm->data + norm->size;
+  size_t out_len =
+      normalize_text(corpus->data + corpus->offsets[idx], len, out);
+  if (out_len == len) {
+    return;
+  }
+  if (norm->count + 1 > norm->items_cap) {
+    norm->items_cap = norm->items_cap == 0 ? 64 : norm->items_cap * 2;
+    norm->offsets =
+        (size_t *)realloc(norm->offsets, norm->items_cap * sizeof(size_t));
+    norm->lens =
+        (uint32_t *)realloc(norm->lens, norm->items_cap * sizeof(uint32_t));
+    norm->masks =
+        (uint64_t *)realloc(norm->masks, norm->items_cap * sizeof(uint64_t));
+  }
+  norm->offsets[norm->count] = norm->size;
+  norm->lens[norm->count] = (uint32_t)out_len;
+  norm->masks[norm->count] = fzf_char_mask(out, out_len);
+  norm->count++;
+  norm->slots[idx] = (uint32_t)norm->count;
+  norm->size += out_len;
+}
+
+static void corpus_push_item(fzf_corpus_t *corpus, size_t offset, size_t len) {
+  if (corpus->count + 1 > corpus->items_cap) {
+    corpus->items_cap = corpus->items_cap == 0 ? 256 : corpus->items_cap * 2;
+    corpus->offsets = (size_t *)realloc(corpus->offsets,
+                                        corpus->items_cap * sizeof(size_t));
+    corpus->lens = (uint32_t *)realloc(corpus->lens,
+                                       corpus->items_cap * sizeof(uint32_t));
+    corpus->masks = (uint64_t *)realloc(corpus->masks,
+                                        corpus->items_cap * sizeof(uint64_t));
+    if (corpus->basenames) {
+      corpus->basenames = (uint32_t *)realloc(
+          corpus->basenames, corpus->items_cap * sizeof(uint32_t));
+    }
+  }
+  corpus->offsets[corpus->count] = offset;
+  corpus->lens[corpus->count] = (uint32_t)len;
+  corpus->masks[corpus->count] = fzf_char_mask(corpus->data + offset, len);
+  if (corpus->basenames) {
+    corpus->basenames[corpus->count] = basename_of(corpus->data + offset, len);
+  }
+  if (corpus->normalized) {
+    normalize_item(corpus, corpus->count);
+  }
+  corpus->count++;
+}
+
+void fzf_corpus_basename_first(fzf_corpus_t *corpus, bool enable) {
+  SFREE(corpus->basenames);
+  corpus->basenames = NULL;
+  if (!enable) {
+    return;
+  }
+  size_t cap = corpus->items_cap > 0 ? corpus->items_cap : 1;
+  corpus->basenames = (uint32_t *)malloc(cap * sizeof(uint32_t));
+  for (size_t i = 0; i < corpus->count; i++) {
+    corpus->basenames[i] =
+        basename_of(corpus->data + corpus->offsets[i], corpus->lens[i]);
+  }
+}
+
+void fzf_corpus_normalize(fzf_corpus_t *corpus, bool enable) {
+  free_normalized(corpus->normalized);
+  corpus->normalized = NULL;
+  if (!enable) {
+    return;
+  }
+  corpus->normalized = (fzf_normalized_t *)malloc(sizeof(fzf_normalized_t));
+  memset(corpus->normalized, 0, sizeof(fzf_normalized_t));
+  for (size_t i = 0; i < corpus->count; i++) {
+    normalize_item(corpus, i);
+  }
+}
+
+fzf_corpus_t *fzf_make_dedup_corpus(void) {
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  corpus->dedup = (fzf_dedup_t *)malloc(sizeof(fzf_dedup_t));
+  memset(corpus->dedup, 0, sizeof(fzf_dedup_t));
+  return corpus;
+}
+
+// FNV-1a, items are short and this is far cheaper than scoring them
+static uint32_t hash_item(const char *item, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char)item[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static void dedup_insert(fzf_dedup_t *dedup, uint64_t entry) {
+  size_t mask = dedup->table_cap - 1;
+  for (size_t slot = (entry >> 32) & mask;; slot = (slot + 1) & mask) {
+    if (dedup->table[slot] == 0) {
+      dedup->table[slot] = entry;
+      return;
+    }
+  }
+}
+
+static void dedup_grow(fzf_dedup_t *dedup) {
+  uint64_t *old = dedup->table;
+  size_t old_cap = dedup->table_cap;
+  dedup->table_cap = old_cap == 0 ? 1024 : old_cap * 2;
+  dedup->table = (uint64_t *)calloc(dedup->table_cap, sizeof(uint64_t));
+  for (size_t i = 0; i < old_cap; i++) {
+    if (old[i] != 0) {
+      dedup_insert(dedup, old[i]);
+    }
+  }
+  SFREE(old);
+}
+
+/* returns the index of an equal item, or -1 after remembering that the item
+ * will be stored as item `corpus->count` */
+static int64_t dedup_find(fzf_corpus_t *corpus, const char *item, size_t len) {
+  fzf_dedup_t *dedup = corpus->dedup;
+  // the table is kept at most half full
+  if ((corpus->count + 1) * 2 > dedup->table_cap) {
+    dedup_grow(dedup);
+  }
+  uint32_t hash = hash_item(item, len);
+  size_t mask = dedup->table_cap - 1;
+  for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    uint64_t entry = dedup->table[slot];
+    if (entry == 0) {
+      dedup->table[slot] = (uint64_t)hash << 32 | (corpus->count + 1);
+      return -1;
+    }
+    size_t idx = (uint32_t)entry - 1;
+    if ((uint32_t)(entry >> 32) == hash && corpus->lens[idx] == len &&
+        memcmp(corpus->data + corpus->offsets[idx], item, len) == 0) {
+      return (int64_t)idx;
+    }
+  }
+}
+
+static void dedup_push_origin(fzf_dedup_t *dedup, uint32_t idx) {
+  if (dedup->inputs + 1 > dedup->origins_cap) {
+    dedup->origins_cap = dedup->origins_cap == 0 ? 256 : dedup->origins_cap * 2;
+    dedup->origins = (uint32_t *)realloc(
+        dedup->origins, dedup->origins_cap * sizeof(uint32_t));
+  }
+  dedup->origins[dedup->inputs] = idx;
+  dedup->inputs++;
+}
+
+void fzf_corpus_append(fzf_corpus_t *corpus, const char *item, size_t len) {
+  if (corpus->dedup) {
+    int64_t idx = dedup_find(corpus, item, len);
+    dedup_push_origin(corpus->dedup,
+                      (uint32_t)(idx >= 0 ? (size_t)idx : corpus->count));
+    if (idx >= 0) {
+      return;
+    }
+  }
+  if (corpus->map) {
+    corpus_unmap(corpus, len);
+  }
+  if (corpus->size + len + 1 > corpus->cap) {
+    size_t cap = corpus->cap == 0 ? 4096 : corpus->cap;
+    while (corpus->size + len + 1 > cap) {
+      cap *= 2;
+    }
+    corpus->data = (char *)realloc(corpus->data, cap);
+    corpus->cap = cap;
+  }
+  memcpy(corpus->data + corpus->size, item, len);
+  corpus->data[corpus->size + len] = '\0';
+  corpus_push_item(corpus, corpus->size, len);
+  corpus->size += len + 1;
+}
+
+size_t fzf_corpus_count(fzf_corpus_t *corpus) {
+  return corpus->count;
+}
+
+size_t fzf_corpus_inputs(fzf_corpus_t *corpus) {
+  return corpus->dedup ? corpus->dedup->inputs : corpus->count;
+}
+
+/* counting sort of the appended items by their distinct item */
+static void dedup_build_fanout(fzf_corpus_t *corpus) {
+  fzf_dedup_t *dedup = corpus->dedup;
+  size_t count = corpus->count;
+  SFREE(dedup->fanout_offsets);
+  SFREE(dedup->fanout);
+  dedup->fanout_offsets = (uint32_t *)calloc(count + 1, sizeof(uint32_t));
+  dedup->fanout = (uint32_t *)malloc(dedup->inputs * sizeof(uint32_t));
+  for (size_t i = 0; i < dedup->inputs; i++) {
+    dedup->fanout_offsets[dedup->origins[i] + 1]++;
+  }
+  for (size_t i = 0; i < count; i++) {
+    dedup->fanout_offsets[i + 1] += dedup->fanout_offsets[i];
+  }
+  uint32_t *next = (uint32_t *)malloc(count * sizeof(uint32_t));
+  memcpy(next, dedup->fanout_offsets, count * sizeof(uint32_t));
+  for (size_t i = 0; i < dedup->inputs; i++) {
+    dedup->fanout[next[dedup->origins[i]]++] = (uint32_t)i;
+  }
+  free(next);
+  dedup->fanout_inputs = dedup->inputs;
+}
+
+const uint32_t *fzf_corpus_fanout(fzf_corpus_t *corpus, size_t idx,
+                                  size_t *n) {
+  fzf_dedup_t *dedup = corpus->dedup;
+  if (dedup == NULL) {
+    *n = 0;
+    return NULL;
+  }
+  if (dedup->fanout_offsets == NULL || dedup->fanout_inputs != dedup->inputs) {
+    dedup_build_fanout(corpus);
+  }
+  *n = dedup->fanout_offsets[idx + 1] - dedup->fanout_offsets[idx];
+  return dedup->fanout + dedup->fanout_offsets[idx];
+}
+
+const char *fzf_corpus_get(fzf_corpus_t *corpus, size_t idx, size_t *len) {
+  if (len) {
+    *len = corpus->lens[idx];
+  }
+  return corpus->data + corpus->offsets[idx];
+}
+
+static fzf_string_t corpus_item(fzf_corpus_t *corpus, size_t idx) {
+  return (fzf_string_t){.data = corpus->data + corpus->offsets[idx],
+                        .size = corpus->lens[idx]};
+}
+
+/* every term set needs one of its terms to match, inverted terms match
+ * without any bytes being present */
+static bool mask_rejects(fzf_pattern_t *pattern, uint64_t mask) {
+  for (size_t i = 0; i < pattern->size; i++) {
+    fzf_term_set_t *term_set = pattern->ptr[i];
+    bool possible = false;
+    for (size_t j = 0; j < term_set->size; j++) {
+      fzf_term_t *term = &term_set->ptr[j];
+      if (term->inv || (term->mask & ~mask) == 0) {
+        possible = true;
+        break;
+      }
+    }
+    if (!possible) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static size_t corpus_basename(fzf_corpus_t *corpus, size_t idx) {
+  return corpus->basenames ? corpus->basenames[idx] : 0;
+}
+
+/* normalized copy of an item for patterns that normalize, 0 if it is matched
+ * as it is */
+static uint32_t corpus_slot(fzf_corpus_t *corpus, size_t idx,
+                            fzf_pattern_t *pattern) {
+  if (!pattern->normalize || corpus->normalized == NULL) {
+    return 0;
+  }
+  return corpus->normalized->slots[idx];
+}
+
+/* the item as the pattern sees it with the offset of its file name */
+static fzf_string_t corpus_input(fzf_corpus_t *corpus, size_t idx,
+                                 uint32_t slot, size_t *basename) {
+  if (slot == 0) {
+    *basename = corpus_basename(corpus, idx);
+    return corpus_item(corpus, idx);
+  }
+  fzf_normalized_t *norm = corpus->normalized;
+  fzf_string_t input = {.data = norm->data + norm->offsets[slot - 1],
+                        .size = norm->lens[slot - 1]};
+  *basename = corpus->basenames ? basename_of(input.data, input.size) : 0;
+  return input;
+}
+
+/* without normalized copies in the corpus, a pattern parsed with normalize
+ * normalizes every item on the fly like fzf_get_score does. Returns the copy
+ * input points to for the caller to free, NULL if the item doesn't change */
+static char *corpus_normalize(fzf_corpus_t *corpus, fzf_pattern_t *pattern,
+                              fzf_string_t *input, size_t *basename) {
+  if (corpus->normalized != NULL) {
+    return NULL;
+  }
+  char *copy = normalize_input(pattern, input);
+  if (copy && corpus->basenames) {
+    *basename = basename_of(input->data, input->size);
+  }
+  return copy;
+}
+
+/* known can be NULL */
+static int32_t corpus_score(fzf_corpus_t *corpus, size_t idx,
+                            fzf_pattern_t *pattern, const known_scores_t *known,
+                            fzf_slab_t *slab) {
+  uint32_t slot = corpus_slot(corpus, idx, pattern);
+  size_t basename;
+  fzf_string_t input = corpus_input(corpus, idx, slot, &basename);
+  char *copy = corpus_normalize(corpus, pattern, &input, &basename);
+  uint64_t mask = copy   ? fzf_char_mask(input.data, input.size)
+                  : slot ? corpus->normalized->masks[slot - 1]
+                         : corpus->masks[idx];
+  int32_t score = 0;
+  if (mask_rejects(pattern, mask)) {
+    STAT_ADD(slab, prefilter_rejects, 1);
+  } else if (known == NULL || known->size == 0 || pattern->ptr == NULL ||
+             copy) {
+    // known results were matched against the stored bytes
+    score = get_score(&input, basename, pattern, slab);
+  } else {
+    item_view_t view;
+    resolve_view(pattern, &input, basename, &view);
+    view.known = known;
+    view.item = idx;
+    score = score_view(&input, &view, pattern, slab);
+  }
+  free(copy);
+  return score;
+}
+
+#ifdef _WIN32
+static char *map_file(const char *path, size_t *size) {
+  HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return NULL;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    *size = 0;
+    return NULL;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(file);
+  if (mapping == NULL) {
+    return NULL;
+  }
+  char *data = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  *size = (size_t)file_size.QuadPart;
+  return data;
+}
+
+static void unmap_file(char *data, size_t size) {
+  UnmapViewOfFile(data);
+}
+#else
+static char *map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    *size = 0;
+    return NULL;
+  }
+  void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+  *size = (size_t)st.st_size;
+  return (char *)data;
+}
+
+static void unmap_file(char *data, size_t size) {
+  munmap(data, size);
+}
+#endif
+
+fzf_corpus_t *fzf_load_corpus(const char *path) {
+  size_t size = (size_t)-1;
+  char *data = map_file(path, &size);
+  if (data == NULL) {
+    // an empty file can't be mapped but is still a valid corpus
+    return size == 0 ? fzf_make_corpus() : NULL;
+  }
+
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  corpus->data = data;
+  corpus->size = size;
+  corpus->map = data;
+  corpus->map_size = size;
+
+  // memchr is vectorized by every libc we care about
+  const char *end = data + size;
+  for (const char *line = data; line < end;) {
+    const char *nl = (const char *)memchr(line, '\n', (size_t)(end - line));
+    const char *line_end = nl ? nl : end;
+    size_t len = (size_t)(line_end - line);
+    if (len > 0 && line[len - 1] == '\r') {
+      len--;
+    }
+    corpus_push_item(corpus, (size_t)(line - data), len);
+    line = line_end + 1;
+  }
+  return corpus;
+}
+
+/* Persistent index
+ *
+ * header | root | item bytes | offsets | lens | masks
+ *
+ * Every section starts at a multiple of 8 so the tables can be used straight
+ * from the mapping. Offsets are stored as size_t, an index written on a
+ * machine with a different size_t or byte order is rejected like a stale one.
+ */
+#define INDEX_MAGIC "FZFINDEX"
+#define INDEX_VERSION 1
+#define INDEX_BYTE_ORDER 0x01020304
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t size_t_size;
+  uint32_t root_len;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t mtime_ns;
+  uint64_t fsize;
+  uint64_t count;
+  uint64_t data_size;
+  uint64_t data_off;
+  uint64_t offsets_off;
+  uint64_t lens_off;
+  uint64_t masks_off;
+  uint64_t file_size;
+} index_header_t;
+
+static uint64_t align8(uint64_t n) {
+  return (n + 7) & ~(uint64_t)7;
+}
+
+static bool index_fingerprint(const char *root, index_header_t *header) {
+  struct stat st;
+  if (stat(root, &st) != 0) {
+    return false;
+  }
+  header->dev = (uint64_t)st.st_dev;
+  header->ino = (uint64_t)st.st_ino;
+#if defined(__APPLE__)
+  header->mtime_ns = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ULL +
+                     (uint64_t)st.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+  header->mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL +
+                     (uint64_t)st.st_mtim.tv_nsec;
+#else
+  header->mtime_ns = (uint64_t)st.st_mtime * 1000000000ULL;
+#endif
+  header->fsize = (uint64_t)st.st_size;
+  return true;
+}
+
+static bool write_section(FILE *file, const void *data, size_t size) {
+  static const char padding[8] = {0};
+  if (size > 0 && fwrite(data, 1, size, file) != size) {
+    return false;
+  }
+  size_t pad = (size_t)(align8(size) - size);
+  return fwrite(padding, 1, pad, file) == pad;
+}
+
+bool fzf_save_index(fzf_corpus_t *corpus, const char *path, const char *root) {
+  index_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+  header.version = INDEX_VERSION;
+  header.byte_order = INDEX_BYTE_ORDER;
+  header.size_t_size = sizeof(size_t);
+  if (!index_fingerprint(root, &header)) {
+    return false;
+  }
+  size_t root_len = strlen(root);
+  size_t count = corpus->count;
+  header.root_len = (uint32_t)root_len;
+  header.count = count;
+  header.data_size = corpus->size;
+  header.data_off = align8(sizeof(header)) + align8(root_len);
+  header.offsets_off = header.data_off + align8(corpus->size);
+  header.lens_off = header.offsets_off + align8(count * sizeof(size_t));
+  header.masks_off = header.lens_off + align8(count * sizeof(uint32_t));
+  header.file_size = header.masks_off + count * sizeof(uint64_t);
+
+  // write to a temporary file first, readers either see the old or the new
+  // index but never a partial one
+  size_t path_len = strlen(path);
+  char *tmp = (char *)malloc(path_len + 5);
+  memcpy(tmp, path, path_len);
+  memcpy(tmp + path_len, ".tmp", 5);
+  FILE *file = fopen(tmp, "wb");
+  if (file == NULL) {
+    free(tmp);
+    return false;
+  }
+  bool ok = write_section(file, &header, sizeof(header)) &&
+            write_section(file, root, root_len) &&
+            write_section(file, corpus->data, corpus->size) &&
+            write_section(file, corpus->offsets, count * sizeof(size_t)) &&
+            write_section(file, corpus->lens, count * sizeof(uint32_t)) &&
+            write_section(file, corpus->masks, count * sizeof(uint64_t));
+  ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+  // rename doesn't replace existing files on windows
+  if (ok) {
+    remove(path);
+  }
+#endif
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) {
+    remove(tmp);
+  }
+  free(tmp);
+  return ok;
+}
+
+static bool index_valid(const char *map, size_t size, const char *root) {
+  if (size < sizeof(index_header_t)) {
+    return false;
+  }
+  index_header_t header;
+  memcpy(&header, map, sizeof(header));
+  if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != INDEX_VERSION ||
+      header.byte_order != INDEX_BYTE_ORDER ||
+      header.size_t_size != sizeof(size_t) || header.file_size != size) {
+    return false;
+  }
+  uint64_t count = header.count;
+  if (header.data_off != align8(sizeof(header)) + align8(header.root_len) ||
+      header.offsets_off != header.data_off + align8(header.data_size) ||
+      header.lens_off != header.offsets_off + align8(count * sizeof(size_t)) ||
+      header.masks_off != header.lens_off + align8(count * sizeof(uint32_t)) ||
+      header.file_size != header.masks_off + count * sizeof(uint64_t)) {
+    return false;
+  }
+  size_t root_len = strlen(root);
+  if (header.root_len != root_len ||
+      memcmp(map + align8(sizeof(header)), root, root_len) != 0) {
+    return false;
+  }
+  index_header_t current;
+  if (!index_fingerprint(root, &current)) {
+    return false;
+  }
+  return header.dev == current.dev && header.ino == current.ino &&
+         header.mtime_ns == current.mtime_ns && header.fsize == current.fsize;
+}
+
+fzf_corpus_t *fzf_load_index(const char *path, const char *root) {
+  size_t size = 0;
+  char *map = map_file(path, &size);
+  if (map == NULL) {
+    return NULL;
+  }
+  if (!index_valid(map, size, root)) {
+    unmap_file(map, size);
+    return NULL;
+  }
+
+  index_header_t header;
+  memcpy(&header, map, sizeof(header));
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  corpus->map = map;
+  corpus->map_size = size;
+  corpus->mapped_tables = true;
+  corpus->data = map + header.data_off;
+  corpus->size = header.data_size;
+  corpus->cap = header.data_size;
+  corpus->offsets = (size_t *)(map + header.offsets_off);
+  corpus->lens = (uint32_t *)(map + header.lens_off);
+  corpus->masks = (uint64_t *)(map + header.masks_off);
+  corpus->count = header.count;
+  corpus->items_cap = header.count;
+  for (size_t i = 0; i < corpus->count; i++) {
+    if (corpus->offsets[i] > corpus->size ||
+        corpus->lens[i] > corpus->size - corpus->offsets[i]) {
+      fzf_free_corpus(corpus);
+      return NULL;
+    }
+  }
+  return corpus;
+}
+
+/* Batch scoring */
+void fzf_matches_init(fzf_matches_t *matches) {
+  memset(matches, 0, sizeof(*matches));
+}
+
+void fzf_matches_free(fzf_matches_t *matches) {
+  SFREE(matches->data);
+  fzf_matches_init(matches);
+}
+
+static void append_match(fzf_matches_t *matches, fzf_match_t match) {
+  if (matches->size + 1 > matches->cap) {
+    matches->cap = matches->cap == 0 ? 64 : matches->cap * 2;
+    matches->data = (fzf_match_t *)realloc(matches->data,
+                                           matches->cap * sizeof(fzf_match_t));
+  }
+  matches->data[matches->size] = match;
+  matches->size++;
+}
+
+// fzf ordering: higher score first, then shorter items, then input order
+static bool match_better(const uint32_t *lens, fzf_match_t a, fzf_match_t b) {
+  if (a.score != b.score) {
+    return a.score > b.score;
+  }
+  if (lens[a.idx] != lens[b.idx]) {
+    return lens[a.idx] < lens[b.idx];
+  }
+  return a.idx < b.idx;
+}
+
+/* the top k are kept in a heap with the worst match at its root */
+static void heap_sift_down(const uint32_t *lens, fzf_matches_t *heap,
+                           size_t i) {
+  fzf_match_t *data = heap->data;
+  for (;;) {
+    size_t l = 2 * i + 1;
+    size_t r = l + 1;
+    size_t worst = i;
+    if (l < heap->size && match_better(lens, data[worst], data[l])) {
+      worst = l;
+    }
+    if (r < heap->size && match_better(lens, data[worst], data[r])) {
+      worst = r;
+    }
+    if (worst == i) {
+      return;
+    }
+    fzf_match_t tmp = data[i];
+    data[i] = data[worst];
+    data[worst] = tmp;
+    i = worst;
+  }
+}
+
+static void heap_push(const uint32_t *lens, fzf_matches_t *heap, size_t k,
+                      fzf_match_t match) {
+  if (k == 0) {
+    return;
+  }
+  if (heap->size < k) {
+    append_match(heap, match);
+    fzf_match_t *data = heap->data;
+    size_t i = heap->size - 1;
+    while (i > 0) {
+      size_t parent = (i - 1) / 2;
+      if (!match_better(lens, data[parent], data[i])) {
+        break;
+      }
+      fzf_match_t tmp = data[i];
+      data[i] = data[parent];
+      data[parent] = tmp;
+      i = parent;
+    }
+  } else if (match_better(lens, match, heap->data[0])) {
+    heap->data[0] = match;
+    heap_sift_down(lens, heap, 0);
+  }
+}
+
+/* consumes the heap, leaving the matches ordered best first */
+static void heap_sort(const uint32_t *lens, fzf_matches_t *heap) {
+  size_t size = heap->size;
+  while (heap->size > 1) {
+    fzf_match_t worst = heap->data[0];
+    heap->data[0] = heap->data[heap->size - 1];
+    heap->data[heap->size - 1] = worst;
+    heap->size--;
+    heap_sift_down(lens, heap, 0);
+  }
+  heap->size = size;
+}
+
+static int32_t blend_score(const fzf_blend_t *blend, size_t idx,
+                           int32_t score) {
+  if (blend == NULL || blend->weights == NULL || idx >= blend->count ||
+      score <= 0) {
+    return score;
+  }
+  float weight = blend->factor * blend->weights[idx];
+  float blended = blend->mode == BlendScale ? (float)score * (1.0f + weight)
+                                            : (float)score + weight;
+  if (blended < 1.0f) {
+    return 1;
+  }
+  if (blended > (float)INT32_MAX) {
+    return INT32_MAX;
+  }
+  return (int32_t)(blended + 0.5f);
+}
+
+/* Path trie
+ *
+ * Sorting the items puts the ones sharing a prefix next to each other, which
+ * walks their trie depth first. The v2 matrix is filled column by column
+ * instead of row by row, every column only depends on the one before, so the
+ * columns of the prefix an item shares with the previous one are kept and
+ * only the rest is computed. The result is the score v2 computes for the item:
+ * rows start at the greedy first occurrence of their char and the window of v2
+ * only drops columns that can't raise the score. */
+
+/* order of items a and b by their bytes, a shorter prefix first */
+static int compare_items(fzf_corpus_t *corpus, uint32_t a, uint32_t b) {
+  uint32_t len_a = corpus->lens[a];
+  uint32_t len_b = corpus->lens[b];
+  int res = memcmp(corpus->data + corpus->offsets[a],
+                   corpus->data + corpus->offsets[b],
+                   len_a < len_b ? len_a : len_b);
+  if (res != 0) {
+    return res;
+  }
+  return len_a < len_b ? -1 : len_a > len_b;
+}
+
+// bottom up merge sort, qsort can't pass the corpus to its comparison
+static void sort_items(fzf_corpus_t *corpus, uint32_t *order, size_t n) {
+  uint32_t *tmp = (uint32_t *)malloc(n * sizeof(uint32_t));
+  uint32_t *src = order;
+  uint32_t *dst = tmp;
+  for (size_t width = 1; width < n; width *= 2) {
+    for (size_t lo = 0; lo < n; lo += 2 * width) {
+      size_t mid = lo + width < n ? lo + width : n;
+      size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+      size_t i = lo;
+      size_t j = mid;
+      for (size_t k = lo; k < hi; k++) {
+        if (i < mid &&
+            (j >= hi || compare_items(corpus, src[i], src[j]) <= 0)) {
+          dst[k] = src[i++];
+        } else {
+          dst[k] = src[j++];
+        }
+      }
+    }
+    uint32_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != order) {
+    memcpy(order, src, n * sizeof(uint32_t));
+  }
+  free(tmp);
+}
+
+void fzf_corpus_path_trie(fzf_corpus_t *corpus, bool enable) {
+  free_trie(corpus->trie);
+  corpus->trie = NULL;
+  if (!enable) {
+    return;
+  }
+  size_t n = corpus->count;
+  fzf_trie_t *trie = (fzf_trie_t *)malloc(sizeof(fzf_trie_t));
+  trie->order = (uint32_t *)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  trie->shared = (uint32_t *)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  trie->count = n;
+  trie->max_len = 0;
+  for (size_t i = 0; i < n; i++) {
+    trie->order[i] = (uint32_t)i;
+    if (corpus->lens[i] > trie->max_len) {
+      trie->max_len = corpus->lens[i];
+    }
+  }
+  sort_items(corpus, trie->order, n);
+  for (size_t i = 0; i < n; i++) {
+    uint32_t shared = 0;
+    if (i > 0) {
+      fzf_string_t a = corpus_item(corpus, trie->order[i - 1]);
+      fzf_string_t b = corpus_item(corpus, trie->order[i]);
+      while (shared < a.size && shared < b.size &&
+             a.data[shared] == b.data[shared]) {
+        shared++;
+      }
+    }
+    trie->shared[i] = shared;
+  }
+  corpus->trie = trie;
+}
+
+/* one column of the v2 matrix per byte of the current path. Column d holds
+ * the state after d bytes, for rows below pidx[d] */
+typedef struct {
+  int16_t *h;
+  int16_t *c;
+  bool *gap;
+  int16_t *bonus;
+  size_t *pidx;
+  int32_t *prev_class;
+  int16_t *max_score;
+} trie_columns_t;
+
+static void trie_column(trie_columns_t *cols, size_t d, char ch,
+                        fzf_string_t *pattern, bool case_sensitive) {
+  const size_t M = pattern->size;
+  int32_t class = char_class_of_ascii(ch);
+  if (!case_sensitive && class == CharUpper) {
+    ch = (char)tolower((uint8_t)ch);
+  }
+  int16_t bonus = bonus_for(cols->prev_class[d], class);
+  cols->bonus[d] = bonus;
+  cols->prev_class[d + 1] = class;
+  size_t pidx = cols->pidx[d];
+  cols->pidx[d + 1] = pidx < M && ch == pattern->data[pidx] ? pidx + 1 : pidx;
+
+  int16_t *h_prev = cols->h + d * M;
+  int16_t *c_prev = cols->c + d * M;
+  bool *gap_prev = cols->gap + d * M;
+  int16_t *h = h_prev + M;
+  int16_t *c = c_prev + M;
+  bool *gap = gap_prev + M;
+  int16_t max_score = cols->max_score[d];
+
+  if (ch == pattern->data[0]) {
+    h[0] = ScoreMatch + bonus * BonusFirstCharMultiplier;
+    c[0] = 1;
+    gap[0] = false;
+  } else {
+    h[0] = max16(h_prev[0] + (gap_prev[0] ? ScoreGapExtention : ScoreGapStart),
+                 0);
+    c[0] = 0;
+    gap[0] = true;
+  }
+  if (M == 1 && h[0] > max_score) {
+    max_score = h[0];
+  }
+  for (size_t i = 1; i < cols->pidx[d + 1]; i++) {
+    // a row starts at the first occurrence of its char
+    bool start = i >= pidx;
+    int16_t left = start ? 0 : h_prev[i];
+    bool in_gap = start ? false : gap_prev[i];
+    int16_t s1 = 0;
+    int16_t s2 = left + (in_gap ? ScoreGapExtention : ScoreGapStart);
+    int16_t consecutive = 0;
+    if (ch == pattern->data[i]) {
+      s1 = h_prev[i - 1] + ScoreMatch;
+      int16_t b = bonus;
+      consecutive = c_prev[i - 1] + 1;
+      if (b == BonusBoundary) {
+        consecutive = 1;
+      } else if (consecutive > 1) {
+        b = max16(b, max16(BonusConsecutive,
+                           cols->bonus[d - (size_t)consecutive + 1]));
+      }
+      if (s1 + b < s2) {
+        s1 += bonus;
+        consecutive = 0;
+      } else {
+        s1 += b;
+      }
+    }
+    c[i] = consecutive;
+    gap[i] = s1 < s2;
+    h[i] = max16(max16(s1, s2), 0);
+    if (i == M - 1 && h[i] > max_score) {
+      max_score = h[i];
+    }
+  }
+  cols->max_score[d + 1] = max_score;
+}
+
+/* walks items in byte order for one fuzzy v2 term, keeping the columns of
+ * the current path */
+typedef struct {
+  fzf_term_t *term;
+  trie_columns_t cols;
+  // columns of the current path that are filled in
+  size_t valid;
+} trie_walk_t;
+
+static void trie_walk_init(trie_walk_t *walk, fzf_term_t *term,
+                           size_t max_len) {
+  const size_t M = ((fzf_string_t *)term->text)->size;
+  const size_t depth = max_len + 1;
+  trie_columns_t *cols = &walk->cols;
+  walk->term = term;
+  walk->valid = 0;
+  cols->h = (int16_t *)malloc(depth * M * sizeof(int16_t));
+  cols->c = (int16_t *)malloc(depth * M * sizeof(int16_t));
+  cols->gap = (bool *)malloc(depth * M * sizeof(bool));
+  cols->bonus = (int16_t *)malloc(depth * sizeof(int16_t));
+  cols->pidx = (size_t *)malloc(depth * sizeof(size_t));
+  cols->prev_class = (int32_t *)malloc(depth * sizeof(int32_t));
+  cols->max_score = (int16_t *)malloc(depth * sizeof(int16_t));
+  cols->h[0] = 0;
+  cols->c[0] = 0;
+  cols->gap[0] = false;
+  cols->pidx[0] = 0;
+  cols->prev_class[0] = CharNonWord;
+  cols->max_score[0] = 0;
+}
+
+static void trie_walk_free(trie_walk_t *walk) {
+  free(walk->cols.h);
+  free(walk->cols.c);
+  free(walk->cols.gap);
+  free(walk->cols.bonus);
+  free(walk->cols.pidx);
+  free(walk->cols.prev_class);
+  free(walk->cols.max_score);
+}
+
+/* passes an item sharing its first `shared` bytes with the one before
+ * without scoring it. Its columns are left out, the next item starts at the
+ * prefix both share */
+static void trie_walk_skip(trie_walk_t *walk, size_t shared) {
+  walk->valid = shared < walk->valid ? shared : walk->valid;
+}
+
+/* score of the term for an item sharing its first `shared` bytes with the
+ * one before, -1 if it doesn't match. Items v2 would match with v1 because
+ * the slab is too small are SCORE_UNKNOWN */
+static int32_t trie_walk_item(trie_walk_t *walk, fzf_string_t *item,
+                              size_t shared, fzf_slab_t *slab) {
+  fzf_term_t *term = walk->term;
+  fzf_string_t *pattern = (fzf_string_t *)term->text;
+  const size_t M = pattern->size;
+  trie_walk_skip(walk, shared);
+  // like v2, skip items that can't contain the term
+  if (ascii_fuzzy_index(item, pattern->data, M, term->case_sensitive, NULL) <
+      0) {
+    return -1;
+  }
+  STAT_ADD(slab, trie_shared_bytes, walk->valid);
+  for (size_t d = walk->valid; d < item->size; d++) {
+    trie_column(&walk->cols, d, item->data[d], pattern, term->case_sensitive);
+  }
+  walk->valid = item->size;
+  if (slab != NULL && item->size * M > slab->I16.cap) {
+    return SCORE_UNKNOWN;
+  }
+  return walk->cols.pidx[item->size] == M ? walk->cols.max_score[item->size]
+                                          : -1;
+}
+
+/* scores of a fuzzy v2 term for the items of the trie, see trie_walk_item */
+static void trie_match(fzf_corpus_t *corpus, fzf_term_t *term,
+                       fzf_slab_t *slab, int32_t *scores) {
+  fzf_trie_t *trie = corpus->trie;
+  trie_walk_t walk;
+  trie_walk_init(&walk, term, trie->max_len);
+  for (size_t k = 0; k < trie->count; k++) {
+    uint32_t idx = trie->order[k];
+    if ((term->mask & ~corpus->masks[idx]) != 0) {
+      trie_walk_skip(&walk, trie->shared[k]);
+      scores[idx] = -1;
+      continue;
+    }
+    fzf_string_t item = corpus_item(corpus, idx);
+    scores[idx] = trie_walk_item(&walk, &item, trie->shared[k], slab);
+  }
+  for (size_t i = trie->count; i < corpus->count; i++) {
+    scores[i] = SCORE_UNKNOWN;
+  }
+  trie_walk_free(&walk);
+}
+
+/* runs the fuzzy terms of pattern over the trie, if the corpus has one and
+ * the terms see whole items */
+static void trie_prepare(fzf_corpus_t *corpus, fzf_pattern_t *pattern,
+                         fzf_slab_t *slab, known_scores_t *known) {
+  known->size = 0;
+  if (corpus->trie == NULL || corpus->trie->count == 0 ||
+      pattern->nth_size > 0 || corpus->basenames != NULL ||
+      (pattern->normalize && corpus->normalized != NULL)) {
+    return;
+  }
+  for (size_t i = 0; i < pattern->size; i++) {
+    fzf_term_set_t *term_set = pattern->ptr[i];
+    for (size_t j = 0; j < term_set->size; j++) {
+      fzf_term_t *term = &term_set->ptr[j];
+      if (term->fn != fzf_fuzzy_match_v2 || known->size == KNOWN_MAX_TERMS) {
+        continue;
+      }
+      known_term_t *entry = &known->terms[known->size++];
+      entry->term = term;
+      entry->scores = (int32_t *)malloc(corpus->count * sizeof(int32_t));
+      trie_match(corpus, term, slab, entry->scores);
+    }
+  }
+}
+
+static void known_free(known_scores_t *known) {
+  for (size_t i = 0; i < known->size; i++) {
+    free(known->terms[i].scores);
+  }
+  known->size = 0;
+}
+
+void fzf_score_all(fzf_corpus_t *corpus, fzf_pattern_t *pattern,
+                   fzf_slab_t *slab, const fzf_blend_t *blend,
+                   fzf_matches_t *out) {
+  out->size = 0;
+  known_scores_t known;
+  trie_prepare(corpus, pattern, slab, &known);
+  for (size_t i = 0; i < corpus->count; i++) {
+    int32_t score =
+        blend_score(blend, i, corpus_score(corpus, i, pattern, &known, slab));
+    if (score > 0) {
+      append_match(out, (fzf_match_t){.idx = (uint32_t)i, .score = score});
+    }
+  }
+  known_free(&known);
+}
+
+/* Upper bounds
+ *
+ * Every matched char scores ScoreMatch plus a bonus, the first one twice, and
+ * gaps only subtract. A bonus is either the bonus of the position itself or,
+ * inside a consecutive run, at most that of the first position of the run or
+ * BonusConsecutive. So for a fuzzy term the best bonus between the first hit
+ * of its first and the last hit of its last char bounds the score without
+ * filling the matrix. Other algorithms are bounded by the best bonus. */
+static char fold_char(char c, bool case_sensitive) {
+  return case_sensitive ? c : (char)tolower((uint8_t)c);
+}
+
+static int32_t term_bound(fzf_term_t *term, fzf_string_t *input,
+                          bool windowed) {
+  fzf_string_t *text = (fzf_string_t *)term->text;
+  const int32_t M = (int32_t)text->size;
+  const int32_t bonus_weight = M + BonusFirstCharMultiplier - 1;
+  if (term->fn != fzf_fuzzy_match_v2 || !windowed || M == 0) {
+    return ScoreMatch * M + BonusBoundary * bonus_weight;
+  }
+
+  size_t first = 0;
+  while (first < input->size &&
+         fold_char(input->data[first], term->case_sensitive) != text->data[0]) {
+    first++;
+  }
+  size_t last = input->size;
+  while (last > first &&
+         fold_char(input->data[last - 1], term->case_sensitive) !=
+             text->data[M - 1]) {
+    last--;
+  }
+  if (last <= first) {
+    return -1;
+  }
+
+  int16_t best = M > 1 ? BonusConsecutive : 0;
+  for (size_t idx = first; idx < last && best < BonusBoundary; idx++) {
+    best = max16(best, bonus_at(input, idx));
+  }
+  return ScoreMatch * M + best * bonus_weight;
+}
+
+/* bound of get_score, 0 if a term can't match */
+static int32_t pattern_bound(fzf_pattern_t *pattern, fzf_string_t *input) {
+  if (pattern->ptr == NULL || pattern->only_inv) {
+    return INT32_MAX;
+  }
+  // fields are matched as slices, which see a boundary at their start. That's
+  // only the case in the whole item if the delimiter isn't a word char
+  bool windowed = pattern->nth_size == 0 || pattern->delimiter == 0 ||
+                  char_class_of(pattern->delimiter) == CharNonWord;
+  int32_t total = 0;
+  for (size_t i = 0; i < pattern->size; i++) {
+    fzf_term_set_t *term_set = pattern->ptr[i];
+    int32_t best = -1;
+    for (size_t j = 0; j < term_set->size; j++) {
+      fzf_term_t *term = &term_set->ptr[j];
+      int32_t bound = term->inv ? 0 : term_bound(term, input, windowed);
+      best = best > bound ? best : bound;
+    }
+    if (best < 0) {
+      return 0;
+    }
+    total += best;
+  }
+  return total;
+}
+
+/* true if item idx can't replace the worst match of a full heap */
+static bool bound_rejects(fzf_corpus_t *corpus, size_t idx,
+                          fzf_pattern_t *pattern, const fzf_blend_t *blend,
+                          fzf_match_t worst) {
+  size_t basename;
+  fzf_string_t input =
+      corpus_input(corpus, idx, corpus_slot(corpus, idx, pattern), &basename);
+  char *copy = corpus_normalize(corpus, pattern, &input, &basename);
+  int32_t bound = blend_score(blend, idx, pattern_bound(pattern, &input));
+  free(copy);
+  // on equal scores the shorter item wins and then the lower index
+  return bound < worst.score ||
+         (bound == worst.score && corpus->lens[idx] >= corpus->lens[worst.idx]);
+}
+
+void fzf_top_k(fzf_corpus_t *corpus, fzf_pattern_t *pattern, fzf_slab_t *slab,
+               const fzf_blend_t *blend, size_t k, fzf_matches_t *out) {
+  out->size = 0;
+  known_scores_t known;
+  trie_prepare(corpus, pattern, slab, &known);
+  for (size_t i = 0; i < corpus->count; i++) {
+    if (k > 0 && out->size == k &&
+        bound_rejects(corpus, i, pattern, blend, out->data[0])) {
+      STAT_ADD(slab, bound_prunes, 1);
+      continue;
+    }
+    int32_t score =
+        blend_score(blend, i, corpus_score(corpus, i, pattern, &known, slab));
+    if (score > 0) {
+      heap_push(corpus->lens, out, k,
+                (fzf_match_t){.idx = (uint32_t)i, .score = score});
+    }
+  }
+  known_free(&known);
+  heap_sort(corpus->lens, out);
+}
+
+/* Front coding
+ *
+ * An item is stored as the length of the prefix it shares with the item
+ * before, the amount of bytes that follow and these bytes, both lengths as
+ * LEB128 varints. Items at a restart point store all their bytes but still
+ * record the prefix, so a scan keeps the matrix columns across blocks. A scan
+ * decodes every item into one buffer that still holds the item before, only
+ * the bytes that differ are copied. */
+static size_t varint_size(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    size++;
+  }
+  return size;
+}
+
+static void put_varint(uint8_t *data, size_t *size, uint32_t value) {
+  while (value >= 0x80) {
+    data[(*size)++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  data[(*size)++] = (uint8_t)value;
+}
+
+static uint32_t get_varint(const uint8_t **p) {
+  uint32_t value = 0;
+  for (uint32_t shift = 0;; shift += 7) {
+    uint8_t byte = *(*p)++;
+    value |= (uint32_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return value;
+    }
+  }
+}
+
+/* decodes the item at p into buf, which holds the item before unless it is a
+ * restart point. Returns its length */
+static size_t fc_next(const uint8_t **p, bool restart, char *buf,
+                      size_t *shared) {
+  *shared = get_varint(p);
+  size_t from = restart ? 0 : *shared;
+  size_t stored = get_varint(p);
+  memcpy(buf + from, *p, stored);
+  *p += stored;
+  return from + stored;
+}
+
+fzf_front_coded_t *fzf_make_front_coded(fzf_corpus_t *corpus) {
+  size_t n = corpus->count;
+  size_t blocks = (n + FZF_FC_BLOCK - 1) / FZF_FC_BLOCK;
+  fzf_front_coded_t *fc =
+      (fzf_front_coded_t *)malloc(sizeof(fzf_front_coded_t));
+  fc->origins = (uint32_t *)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  fc->ranks = (uint32_t *)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  fc->lens = (uint32_t *)malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+  fc->restarts = (size_t *)malloc((blocks > 0 ? blocks : 1) * sizeof(size_t));
+  fc->count = n;
+  fc->max_len = 0;
+  fc->basename_first = corpus->basenames != NULL;
+  for (size_t i = 0; i < n; i++) {
+    fc->origins[i] = (uint32_t)i;
+    fc->lens[i] = corpus->lens[i];
+    if (corpus->lens[i] > fc->max_len) {
+      fc->max_len = corpus->lens[i];
+    }
+  }
+  sort_items(corpus, fc->origins, n);
+
+  // ranks holds the shared prefixes until the items are encoded
+  size_t size = 0;
+  for (size_t k = 0; k < n; k++) {
+    fzf_string_t item = corpus_item(corpus, fc->origins[k]);
+    uint32_t shared = 0;
+    if (k > 0) {
+      fzf_string_t prev = corpus_item(corpus, fc->origins[k - 1]);
+      while (shared < prev.size && shared < item.size &&
+             prev.data[shared] == item.data[shared]) {
+        shared++;
+      }
+    }
+    fc->ranks[k] = shared;
+    uint32_t stored =
+        (uint32_t)item.size - (k % FZF_FC_BLOCK == 0 ? 0 : shared);
+    size += varint_size(shared) + varint_size(stored) + stored;
+  }
+  fc->data = (uint8_t *)malloc(size > 0 ? size : 1);
+  fc->size = 0;
+  for (size_t k = 0; k < n; k++) {
+    fzf_string_t item = corpus_item(corpus, fc->origins[k]);
+    uint32_t shared = fc->ranks[k];
+    size_t from = 0;
+    if (k % FZF_FC_BLOCK == 0) {
+      fc->restarts[k / FZF_FC_BLOCK] = fc->size;
+    } else {
+      from = shared;
+    }
+    put_varint(fc->data, &fc->size, shared);
+    put_varint(fc->data, &fc->size, (uint32_t)(item.size - from));
+    memcpy(fc->data + fc->size, item.data + from, item.size - from);
+    fc->size += item.size - from;
+  }
+  for (size_t k = 0; k < n; k++) {
+    fc->ranks[fc->origins[k]] = (uint32_t)k;
+  }
+  return fc;
+}
+
+void fzf_free_front_coded(fzf_front_coded_t *fc) {
+  if (fc) {
+    SFREE(fc->data);
+    SFREE(fc->restarts);
+    SFREE(fc->origins);
+    SFREE(fc->ranks);
+    SFREE(fc->lens);
+    SFREE(fc);
+  }
+}
+
+size_t fzf_front_coded_count(fzf_front_coded_t *fc) {
+  return fc->count;
+}
+
+size_t fzf_front_coded_bytes(fzf_front_coded_t *fc) {
+  size_t blocks = (fc->count + FZF_FC_BLOCK - 1) / FZF_FC_BLOCK;
+  return sizeof(fzf_front_coded_t) + fc->size + blocks * sizeof(size_t) +
+         3 * fc->count * sizeof(uint32_t);
+}
+
+size_t fzf_front_coded_get(fzf_front_coded_t *fc, size_t idx, char *buf,
+                           size_t cap) {
+  char *item = cap > fc->max_len ? buf : (char *)malloc(fc->max_len + 1);
+  size_t rank = fc->ranks[idx];
+  size_t first = rank - rank % FZF_FC_BLOCK;
+  const uint8_t *p = fc->data + fc->restarts[rank / FZF_FC_BLOCK];
+  size_t len = 0;
+  size_t shared;
+  for (size_t k = first; k <= rank; k++) {
+    len = fc_next(&p, k == first, item, &shared);
+  }
+  if (item == buf) {
+    buf[len] = '\0';
+  } else {
+    if (cap > 0) {
+      size_t n = len < cap - 1 ? len : cap - 1;
+      memcpy(buf, item, n);
+      buf[n] = '\0';
+    }
+    free(item);
+  }
+  return len;
+}
+
+/* fuzzy v2 terms walk the items like a path trie. Their scores for the
+ * current item are passed to the matchers as known results */
+typedef struct {
+  trie_walk_t walks[KNOWN_MAX_TERMS];
+  int32_t scores[KNOWN_MAX_TERMS];
+  known_scores_t known;
+} fc_walks_t;
+
+static void fc_walks_init(fzf_front_coded_t *fc, fzf_pattern_t *pattern,
+                          fc_walks_t *walks) {
+  known_scores_t *known = &walks->known;
+  known->size = 0;
+  if (pattern->ptr == NULL || pattern->nth_size > 0 || fc->basename_first) {
+    return;
+  }
+  for (size_t i = 0; i < pattern->size; i++) {
+    fzf_term_set_t *term_set = pattern->ptr[i];
+    for (size_t j = 0; j < term_set->size; j++) {
+      fzf_term_t *term = &term_set->ptr[j];
+      if (term->fn != fzf_fuzzy_match_v2 || known->size == KNOWN_MAX_TERMS) {
+        continue;
+      }
+      trie_walk_init(&walks->walks[known->size], term, fc->max_len);
+      known->terms[known->size].term = term;
+      known->terms[known->size].scores = &walks->scores[known->size];
+      known->size++;
+    }
+  }
+}
+
+static void fc_walks_free(fc_walks_t *walks) {
+  for (size_t i = 0; i < walks->known.size; i++) {
+    trie_walk_free(&walks->walks[i]);
+  }
+}
+
+/* true if item idx can't replace the worst match of a full heap. Items come
+ * in byte order, so equal bounds are decided like in the heap */
+static bool fc_bound_rejects(fzf_front_coded_t *fc, uint32_t idx,
+                             fzf_string_t *input, fzf_pattern_t *pattern,
+                             const fzf_blend_t *blend, fzf_match_t worst) {
+  int32_t bound = blend_score(blend, idx, pattern_bound(pattern, input));
+  return !match_better(fc->lens, (fzf_match_t){.idx = idx, .score = bound},
+                       worst);
+}
+
+/* scans the items in byte order, with top only the best k are kept */
+static void fc_scan(fzf_front_coded_t *fc, fzf_pattern_t *pattern,
+                    fzf_slab_t *slab, const fzf_blend_t *blend, size_t k,
+                    bool top, fzf_matches_t *out) {
+  out->size = 0;
+  fc_walks_t walks;
+  fc_walks_init(fc, pattern, &walks);
+  char *buf = (char *)malloc(fc->max_len + 1);
+  const uint8_t *p = fc->data;
+  for (size_t rank = 0; rank < fc->count; rank++) {
+    size_t shared;
+    fzf_string_t input = {
+        .data = buf,
+        .size = fc_next(&p, rank % FZF_FC_BLOCK == 0, buf, &shared)};
+    uint32_t idx = fc->origins[rank];
+    // the columns only see the stored bytes, a normalized copy is matched
+    // as usual
+    char *normalized = normalize_input(pattern, &input);
+    if (top && k > 0 && out->size == k &&
+        fc_bound_rejects(fc, idx, &input, pattern, blend, out->data[0])) {
+      for (size_t i = 0; i < walks.known.size; i++) {
+        trie_walk_skip(&walks.walks[i], shared);
+      }
+      STAT_ADD(slab, bound_prunes, 1);
+      free(normalized);
+      continue;
+    }
+    for (size_t i = 0; i < walks.known.size; i++) {
+      if (normalized) {
+        trie_walk_skip(&walks.walks[i], shared);
+        walks.scores[i] = SCORE_UNKNOWN;
+      } else {
+        walks.scores[i] =
+            trie_walk_item(&walks.walks[i], &input, shared, slab);
+      }
+    }
+    size_t basename =
+        fc->basename_first ? basename_of(input.data, input.size) : 0;
+    int32_t score = 1;
+    if (pattern->ptr != NULL) {
+      item_view_t view;
+      resolve_view(pattern, &input, basename, &view);
+      view.known = &walks.known;
+      view.item = 0;
+      score = score_view(&input, &view, pattern, slab);
+    }
+    free(normalized);
+    score = blend_score(blend, idx, score);
+    if (score <= 0) {
+      continue;
+    }
+    fzf_match_t match = {.idx = idx, .score = score};
+    if (top) {
+      heap_push(fc->lens, out, k, match);
+    } else {
+      append_match(out, match);
+    }
+  }
+  free(buf);
+  fc_walks_free(&walks);
+  if (top) {
+    heap_sort(fc->lens, out);
+  }
+}
+
+void fzf_front_coded_score_all(fzf_front_coded_t *fc, fzf_pattern_t *pattern,
+                               fzf_slab_t *slab, const fzf_blend_t *blend,
+                               fzf_matches_t *out) {
+  fc_scan(fc, pattern, slab, blend, 0, false, out);
+}
+
+void fzf_front_coded_top_k(fzf_front_coded_t *fc, fzf_pattern_t *pattern,
+                           fzf_slab_t *slab, const fzf_blend_t *blend,
+                           size_t k, fzf_matches_t *out) {
+  fc_scan(fc, pattern, slab, blend, k, true, out);
+}
+
+/* Full ordering
+ *
+ * Matches are ordered by a 64 bit key with the inverted score in the upper and
+ * the item length in the lower half, sorted with an LSD radix sort over
+ * bytes. The sort is stable, so equal keys keep their (index) order. Bytes
+ * that are the same for every key, e.g. the upper bytes of the length, are
+ * skipped. */
+typedef struct {
+  uint64_t key;
+  fzf_match_t match;
+} keyed_match_t;
+
+static uint64_t sort_key(fzf_corpus_t *corpus, fzf_match_t match) {
+  uint64_t score = (uint32_t)(INT32_MAX - match.score);
+  return score << 32 | corpus->lens[match.idx];
+}
+
+void fzf_sort_matches(fzf_corpus_t *corpus, fzf_matches_t *matches) {
+  size_t n = matches->size;
+  if (n < 2) {
+    return;
+  }
+  keyed_match_t *src = (keyed_match_t *)malloc(n * sizeof(keyed_match_t));
+  keyed_match_t *dst = (keyed_match_t *)malloc(n * sizeof(keyed_match_t));
+  size_t counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = sort_key(corpus, matches->data[i]);
+    src[i] = (keyed_match_t){.key = key, .match = matches->data[i]};
+    for (size_t b = 0; b < 8; b++) {
+      counts[b][(key >> (b * 8)) & 0xff]++;
+    }
+  }
+
+  for (size_t b = 0; b < 8; b++) {
+    size_t shift = b * 8;
+    if (counts[b][(src[0].key >> shift) & 0xff] == n) {
+      continue;
+    }
+    size_t offsets[256];
+    size_t sum = 0;
+    for (size_t d = 0; d < 256; d++) {
+      offsets[d] = sum;
+      sum += counts[b][d];
+    }
+    for (size_t i = 0; i < n; i++) {
+      dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+    }
+    keyed_match_t *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    matches->data[i] = src[i].match;
+  }
+  free(src);
+  free(dst);
+}
+
+void fzf_expand_matches(fzf_corpus_t *corpus, const fzf_matches_t *matches,
+                        fzf_matches_t *out) {
+  out->size = 0;
+  for (size_t i = 0; i < matches->size; i++) {
+    fzf_match_t match = matches->data[i];
+    if (corpus->dedup == NULL) {
+      append_match(out, match);
+      continue;
+    }
+    size_t n = 0;
+    const uint32_t *fanout = fzf_corpus_fanout(corpus, match.idx, &n);
+    for (size_t j = 0; j < n; j++) {
+      append_match(out, (fzf_match_t){.idx = fanout[j], .score = match.score});
+    }
+  }
+}
+
+/* Result buffers: one allocation holding the header and all arrays, so lua
+ * can index them in place and free everything with a single release */
+fzf_result_buf_t *fzf_make_result_buf(fzf_corpus_t *corpus,
+                                      const fzf_matches_t *matches,
+                                      fzf_pattern_t *pattern,
+                                      fzf_slab_t *slab) {
+  size_t n = matches->size;
+  size_t arrays = pattern ? 4 : 2;
+  fzf_result_buf_t *buf = (fzf_result_buf_t *)malloc(
+      sizeof(fzf_result_buf_t) + n * arrays * sizeof(uint32_t));
+  memset(buf, 0, sizeof(*buf));
+  buf->size = n;
+  buf->refs = 1;
+  buf->idx = (uint32_t *)(buf + 1);
+  buf->score = (int32_t *)(buf->idx + n);
+  for (size_t i = 0; i < n; i++) {
+    buf->idx[i] = matches->data[i].idx;
+    buf->score[i] = matches->data[i].score;
+  }
+  if (pattern == NULL) {
+    return buf;
+  }
+
+  buf->begin = (uint32_t *)(buf->score + n);
+  buf->end = buf->begin + n;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t slot = corpus_slot(corpus, buf->idx[i], pattern);
+    size_t basename;
+    fzf_string_t input = corpus_input(corpus, buf->idx[i], slot, &basename);
+    char *copy = corpus_normalize(corpus, pattern, &input, &basename);
+    bool normalized = slot || copy;
+    fzf_position_t *pos = get_positions(&input, basename, pattern, slab);
+    free(copy);
+    fzf_string_t item = corpus_item(corpus, buf->idx[i]);
+    if (normalized) {
+      denormalize_positions(item.data, item.size, pos);
+    }
+    uint32_t begin = 0;
+    uint32_t end = 0;
+    if (pos && pos->size > 0) {
+      begin = UINT32_MAX;
+      for (size_t j = 0; j < pos->size; j++) {
+        begin = pos->data[j] < begin ? pos->data[j] : begin;
+        end = pos->data[j] + 1 > end ? pos->data[j] + 1 : end;
+      }
+      // a normalized letter ends with the rest of its rune
+      while (normalized && end < item.size &&
+             is_continuation((unsigned char)item.data[end])) {
+        end++;
+      }
+    }
+    fzf_free_positions(pos);
+    buf->begin[i] = begin;
+    buf->end[i] = end;
+  }
+  return buf;
+}
+
+fzf_result_buf_t *fzf_retain_result_buf(fzf_result_buf_t *buf) {
+  atomic_add64(&buf->refs, 1);
+  return buf;
+}
+
+void fzf_release_result_buf(fzf_result_buf_t *buf) {
+  if (buf && atomic_dec64(&buf->refs) == 0) {
+    free(buf);
+  }
+}
+
+/* Match cache
+ *
+ * Scoring with fzf_cached_score collects the positions in the same pass and
+ * keeps them for the k best items of the current pattern, replacing the worst
+ * entry once full. Items are found again by hash and compared byte wise. A
+ * pattern with another id starts over. */
+typedef struct {
+  char *text;
+  size_t len;
+  uint32_t hash;
+  int32_t score;
+  uint32_t *pos;
+  size_t pos_size;
+} cache_entry_t;
+
+struct fzf_match_cache_s {
+  uint64_t pattern_id;
+  cache_entry_t *entries;
+  size_t size;
+  size_t cap;
+  size_t worst;
+  fzf_position_t *scratch;
+};
+
+fzf_match_cache_t *fzf_make_match_cache(size_t k) {
+  fzf_match_cache_t *cache =
+      (fzf_match_cache_t *)malloc(sizeof(fzf_match_cache_t));
+  memset(cache, 0, sizeof(*cache));
+  cache->cap = k;
+  cache->entries = (cache_entry_t *)malloc(k * sizeof(cache_entry_t));
+  cache->scratch = fzf_pos_array(0);
+  return cache;
+}
+
+static void cache_entry_free(cache_entry_t *entry) {
+  free(entry->text);
+  SFREE(entry->pos);
+}
+
+static void cache_reset(fzf_match_cache_t *cache, uint64_t pattern_id) {
+  for (size_t i = 0; i < cache->size; i++) {
+    cache_entry_free(&cache->entries[i]);
+  }
+  cache->size = 0;
+  cache->worst = 0;
+  cache->pattern_id = pattern_id;
+}
+
+void fzf_free_match_cache(fzf_match_cache_t *cache) {
+  if (cache) {
+    cache_reset(cache, 0);
+    free(cache->entries);
+    fzf_free_positions(cache->scratch);
+    free(cache);
+  }
+}
+
+static cache_entry_t *cache_find(fzf_match_cache_t *cache, const char *text,
+                                 size_t len, uint32_t hash) {
+  for (size_t i = 0; i < cache->size; i++) {
+    cache_entry_t *entry = &cache->entries[i];
+    if (entry->hash == hash && entry->len == len &&
+        memcmp(entry->text, text, len) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+static void cache_insert(fzf_match_cache_t *cache, const char *text,
+                         size_t len, int32_t score, fzf_position_t *pos) {
+  bool full = cache->size == cache->cap;
+  if (cache->cap == 0 ||
+      (full && score <= cache->entries[cache->worst].score)) {
+    return;
+  }
+  uint32_t hash = hash_item(text, len);
+  cache_entry_t *entry = cache_find(cache, text, len, hash);
+  if (entry) {
+    SFREE(entry->pos);
+  } else {
+    if (full) {
+      entry = &cache->entries[cache->worst];
+      cache_entry_free(entry);
+    } else {
+      entry = &cache->entries[cache->size++];
+    }
+    entry->text = (char *)malloc(len + 1);
+    memcpy(entry->text, text, len + 1);
+    entry->len = len;
+    entry->hash = hash;
+  }
+  entry->score = score;
+  entry->pos_size = pos->size;
+  entry->pos = NULL;
+  if (pos->size > 0) {
+    entry->pos = (uint32_t *)malloc(pos->size * sizeof(uint32_t));
+    memcpy(entry->pos, pos->data, pos->size * sizeof(uint32_t));
+  }
+
+  cache->worst = 0;
+  for (size_t i = 1; i < cache->size; i++) {
+    if (cache->entries[i].score < cache->entries[cache->worst].score) {
+      cache->worst = i;
+    }
+  }
+}
+
+int32_t fzf_cached_score(fzf_match_cache_t *cache, const char *text,
+                         fzf_pattern_t *pattern, fzf_slab_t *slab) {
+  if (pattern->ptr == NULL) {
+    return 1;
+  }
+  if (cache->pattern_id != pattern->id) {
+    cache_reset(cache, pattern->id);
+  }
+  uint64_t start = probe_enter(ProbeGetScore, text);
+  size_t len = strlen(text);
+  fzf_string_t input = {.data = text, .size = len};
+  char *normalized = normalize_input(pattern, &input);
+  cache->scratch->size = 0;
+  int32_t score;
+  if (match_item(&input, 0, pattern, cache->scratch, slab, &score)) {
+    if (normalized) {
+      denormalize_positions(text, len, cache->scratch);
+    }
+    cache_insert(cache, text, len, score, cache->scratch);
+  }
+  free(normalized);
+  probe_exit(ProbeGetScore, text, start, score);
+  return score;
+}
+
+fzf_position_t *fzf_cached_positions(fzf_match_cache_t *cache, const char *text,
+                                     fzf_pattern_t *pattern, fzf_slab_t *slab) {
+  if (pattern->ptr != NULL && cache->pattern_id == pattern->id) {
+    size_t len = strlen(text);
+    cache_entry_t *entry = cache_find(cache, text, len, hash_item(text, len));
+    if (entry) {
+      fzf_position_t *pos = fzf_pos_array(entry->pos_size);
+      if (entry->pos_size > 0) {
+        memcpy(pos->data, entry->pos, entry->pos_size * sizeof(uint32_t));
+      }
+      pos->size = entry->pos_size;
+      return pos;
+    }
+  }
+  return fzf_get_positions(text, pattern, slab);
+}
+
+/* Streaming */
+/* Row cache
+ *
+ * While a prompt grows one char at a time, the first rows of the v2 matrix of
+ * a fuzzy term stay the same for every item. The cache keeps the last row of
+ * every match, so a longer term only fills the rows of the chars it adds.
+ * Rows start at the first occurrence of their char after the one of the row
+ * before, like in v2, and run to the end of the item instead of the window of
+ * v2: past the last occurrence of the last char a row only decreases, the
+ * score is the same. */
+#define NO_ROW SIZE_MAX
+
+static fzf_row_cache_t *make_row_cache(void) {
+  fzf_row_cache_t *rows = (fzf_row_cache_t *)malloc(sizeof(fzf_row_cache_t));
+  memset(rows, 0, sizeof(*rows));
+  return rows;
+}
+
+static void free_row_cache(fzf_row_cache_t *rows) {
+  if (rows) {
+    SFREE(rows->data);
+    SFREE(rows->offsets);
+    SFREE(rows->starts);
+    SFREE(rows->term);
+    SFREE(rows->scratch);
+    SFREE(rows);
+  }
+}
+
+void fzf_stream_row_cache(fzf_stream_t *stream, bool enable) {
+  free_row_cache(stream->rows);
+  free_row_cache(stream->prev_rows);
+  stream->rows = enable ? make_row_cache() : NULL;
+  stream->prev_rows = enable ? make_row_cache() : NULL;
+}
+
+/* the term of a prompt that can use rows: a single fuzzy term matched
+ * against whole items */
+static fzf_term_t *row_term(fzf_stream_t *stream) {
+  fzf_pattern_t *pattern = stream->pattern;
+  if (pattern->size != 1 || pattern->ptr[0]->size != 1 ||
+      pattern->nth_size > 0 || stream->corpus->basenames != NULL) {
+    return NULL;
+  }
+  fzf_term_t *term = &pattern->ptr[0]->ptr[0];
+  fzf_string_t *text = (fzf_string_t *)term->text;
+  if (term->fn != fzf_fuzzy_match_v2 || term->inv || text->size == 0 ||
+      !is_ascii(text->data, text->size)) {
+    return NULL;
+  }
+  return term;
+}
+
+/* swaps in the rows of a new prompt before the stream is rescored. The rows
+ * of the previous prompt are kept if its term is a prefix of the new one */
+static void rows_begin(fzf_stream_t *stream) {
+  if (stream->rows == NULL) {
+    return;
+  }
+  fzf_row_cache_t *prev = stream->rows;
+  fzf_row_cache_t *rows = stream->prev_rows;
+  stream->rows = rows;
+  stream->prev_rows = prev;
+  rows->size = 0;
+  for (size_t i = 0; i < rows->items_cap; i++) {
+    rows->offsets[i] = NO_ROW;
+  }
+  free(rows->term);
+  rows->term = NULL;
+  fzf_term_t *term = row_term(stream);
+  if (term == NULL) {
+    return;
+  }
+  fzf_string_t *text = (fzf_string_t *)term->text;
+  rows->term = strndup(text->data, text->size);
+  rows->term_size = text->size;
+  rows->case_sensitive = term->case_sensitive;
+  if (prev->term != NULL &&
+      (prev->case_sensitive != rows->case_sensitive ||
+       prev->term_size > rows->term_size ||
+       memcmp(prev->term, rows->term, prev->term_size) != 0)) {
+    free(prev->term);
+    prev->term = NULL;
+  }
+}
+
+static void rows_end(fzf_stream_t *stream) {
+  if (stream->prev_rows) {
+    free(stream->prev_rows->term);
+    stream->prev_rows->term = NULL;
+  }
+}
+
+static int16_t *rows_scratch(fzf_row_cache_t *rows, size_t size) {
+  if (size > rows->scratch_cap) {
+    rows->scratch_cap = size;
+    SFREE(rows->scratch);
+    rows->scratch = (int16_t *)malloc(size * sizeof(int16_t));
+  }
+  return rows->scratch;
+}
+
+static void rows_store(fzf_row_cache_t *rows, size_t idx, size_t start,
+                       const int16_t *h, const int16_t *c, size_t len) {
+  if (idx >= rows->items_cap) {
+    size_t cap = rows->items_cap ? rows->items_cap : 64;
+    while (cap <= idx) {
+      cap *= 2;
+    }
+    rows->offsets = (size_t *)realloc(rows->offsets, cap * sizeof(size_t));
+    rows->starts = (uint32_t *)realloc(rows->starts, cap * sizeof(uint32_t));
+    for (size_t i = rows->items_cap; i < cap; i++) {
+      rows->offsets[i] = NO_ROW;
+    }
+    rows->items_cap = cap;
+  }
+  if (rows->size + 2 * len > rows->cap) {
+    rows->cap = rows->cap ? rows->cap : 1024;
+    while (rows->size + 2 * len > rows->cap) {
+      rows->cap *= 2;
+    }
+    rows->data = (int16_t *)realloc(rows->data, rows->cap * sizeof(int16_t));
+  }
+  rows->offsets[idx] = rows->size;
+  rows->starts[idx] = (uint32_t)start;
+  memcpy(rows->data + rows->size, h, len * sizeof(int16_t));
+  memcpy(rows->data + rows->size + len, c, len * sizeof(int16_t));
+  rows->size += 2 * len;
+}
+
+/* fills row i of the matrix for the columns [start, n) from the row before,
+ * which starts before start. Returns the best score of the row */
+static int16_t fill_row(fzf_string_t *input, const int16_t *bonus, size_t i,
+                        char pchar, bool case_sensitive, size_t start,
+                        const int16_t *h_prev, const int16_t *c_prev,
+                        size_t prev_start, int16_t *h, int16_t *c) {
+  int16_t max_score = 0;
+  int16_t left = 0;
+  bool in_gap = false;
+  for (size_t col = start; col < input->size; col++) {
+    char ch = fold_char(input->data[col], case_sensitive);
+    size_t j = col - start;
+    int16_t s1 = 0;
+    int16_t s2 = left + (in_gap ? ScoreGapExtention : ScoreGapStart);
+    int16_t consecutive = 0;
+    if (i == 0) {
+      // the first row restarts at every occurrence of its char
+      bool match = ch == pchar;
+      h[j] = match ? ScoreMatch + bonus[col] * BonusFirstCharMultiplier
+                   : max16(s2, 0);
+      c[j] = match;
+      in_gap = !match;
+      left = h[j];
+      max_score = h[j] > max_score ? h[j] : max_score;
+      continue;
+    }
+    if (ch == pchar) {
+      s1 = h_prev[col - 1 - prev_start] + ScoreMatch;
+      int16_t b = bonus[col];
+      consecutive = c_prev[col - 1 - prev_start] + 1;
+      if (b == BonusBoundary) {
+        consecutive = 1;
+      } else if (consecutive > 1) {
+        b = max16(b, max16(BonusConsecutive,
+                           bonus[col - (size_t)consecutive + 1]));
+      }
+      if (s1 + b < s2) {
+        s1 += bonus[col];
+        consecutive = 0;
+      } else {
+        s1 += b;
+      }
+    }
+    c[j] = consecutive;
+    in_gap = s1 < s2;
+    h[j] = max16(max16(s1, s2), 0);
+    left = h[j];
+    max_score = h[j] > max_score ? h[j] : max_score;
+  }
+  return max_score;
+}
+
+/* v2 score of the single fuzzy prompt term for item idx, continuing from the
+ * row the previous prompt left for it */
+static int32_t rows_score(fzf_stream_t *stream, size_t idx,
+                          fzf_slab_t *slab) {
+  fzf_corpus_t *corpus = stream->corpus;
+  fzf_pattern_t *pattern = stream->pattern;
+  fzf_row_cache_t *rows = stream->rows;
+  fzf_row_cache_t *prev = stream->prev_rows;
+  fzf_term_t *term = &pattern->ptr[0]->ptr[0];
+  fzf_string_t *text = (fzf_string_t *)term->text;
+  const size_t M = text->size;
+  uint32_t slot = corpus_slot(corpus, idx, pattern);
+  uint64_t mask = slot ? corpus->normalized->masks[slot - 1]
+                       : corpus->masks[idx];
+  if (mask_rejects(pattern, mask)) {
+    STAT_ADD(slab, prefilter_rejects, 1);
+    return 0;
+  }
+  size_t basename;
+  fzf_string_t input = corpus_input(corpus, idx, slot, &basename);
+  const size_t N = input.size;
+  if (slab != NULL && N * M > slab->I16.cap) {
+    // v2 might fall back to v1
+    return corpus_score(corpus, idx, pattern, NULL, slab);
+  }
+
+  size_t first = 0;
+  size_t start = 0;
+  const int16_t *h_prev = NULL;
+  const int16_t *c_prev = NULL;
+  if (prev->term != NULL && idx < prev->items_cap &&
+      prev->offsets[idx] != NO_ROW) {
+    first = prev->term_size;
+    start = prev->starts[idx];
+    h_prev = prev->data + prev->offsets[idx];
+    c_prev = h_prev + (N - start);
+    STAT_ADD(slab, cached_rows, first);
+  }
+  // first occurrences of the added chars, the columns their rows start at
+  size_t col = first > 0 ? start + 1 : 0;
+  for (size_t i = first; i < M; i++) {
+    while (col < N &&
+           fold_char(input.data[col], term->case_sensitive) != text->data[i]) {
+      col++;
+    }
+    if (col == N) {
+      STAT_ADD(slab, prefilter_rejects, 1);
+      return 0;
+    }
+    col++;
+  }
+  STAT_ADD(slab, fuzzy_v2_calls, 1);
+
+  int16_t *scratch = rows_scratch(rows, 5 * N);
+  int16_t *bonus = scratch;
+  int16_t *bufs[2][2] = {{scratch + N, scratch + 2 * N},
+                         {scratch + 3 * N, scratch + 4 * N}};
+  int32_t prev_class = CharNonWord;
+  for (size_t i = 0; i < N; i++) {
+    int32_t class = char_class_of_ascii(input.data[i]);
+    bonus[i] = bonus_for(prev_class, class);
+    prev_class = class;
+  }
+
+  int16_t max_score = 0;
+  size_t row_start = start;
+  const int16_t *h = h_prev;
+  const int16_t *c = c_prev;
+  for (size_t i = first; i < M; i++) {
+    size_t begin = i > 0 ? row_start + 1 : 0;
+    while (fold_char(input.data[begin], term->case_sensitive) !=
+           text->data[i]) {
+      begin++;
+    }
+    int16_t *h_next = bufs[i % 2][0];
+    int16_t *c_next = bufs[i % 2][1];
+    max_score = fill_row(&input, bonus, i, text->data[i],
+                         term->case_sensitive, begin, h, c, row_start, h_next,
+                         c_next);
+    h = h_next;
+    c = c_next;
+    row_start = begin;
+  }
+  if (first == M) {
+    for (size_t j = 0; j < N - start; j++) {
+      max_score = h[j] > max_score ? h[j] : max_score;
+    }
+  }
+  if (max_score > 0) {
+    rows_store(rows, idx, row_start, h, c, N - row_start);
+  }
+  return max_score;
+}
+
+fzf_stream_t *fzf_make_stream(fzf_case_types case_mode, bool normalize,
+                              bool fuzzy, size_t k) {
+  fzf_stream_t *stream = (fzf_stream_t *)malloc(sizeof(fzf_stream_t));
+  memset(stream, 0, sizeof(*stream));
+  stream->corpus = fzf_make_corpus();
+  // items are normalized once on push instead of on every prompt
+  fzf_corpus_normalize(stream->corpus, normalize);
+  stream->case_mode = case_mode;
+  stream->normalize = normalize;
+  stream->fuzzy = fuzzy;
+  stream->k = k;
+  stream->prompt = strdup("");
+  stream->pattern = parse_pattern(case_mode, false, stream->prompt, fuzzy);
+  return stream;
+}
+
+void fzf_free_stream(fzf_stream_t *stream) {
+  if (stream) {
+    fzf_free_corpus(stream->corpus);
+    fzf_free_pattern(stream->pattern);
+    SFREE(stream->prompt);
+    SFREE(stream->nth);
+    fzf_matches_free(&stream->matched);
+    fzf_matches_free(&stream->top);
+    fzf_matches_free(&stream->sorted);
+    free_row_cache(stream->rows);
+    free_row_cache(stream->prev_rows);
+    free(stream);
+  }
+}
+
+static void stream_score(fzf_stream_t *stream, size_t idx, fzf_slab_t *slab) {
+  int32_t score =
+      stream->rows && stream->rows->term
+          ? rows_score(stream, idx, slab)
+          : corpus_score(stream->corpus, idx, stream->pattern, NULL, slab);
+  score = blend_score(&stream->blend, idx, score);
+  if (score > 0) {
+    fzf_match_t match = {.idx = (uint32_t)idx, .score = score};
+    append_match(&stream->matched, match);
+    heap_push(stream->corpus->lens, &stream->top, stream->k, match);
+  }
+}
+
+void fzf_stream_update(fzf_stream_t *stream, fzf_slab_t *slab) {
+  for (size_t i = stream->scored; i < stream->corpus->count; i++) {
+    stream_score(stream, i, slab);
+  }
+  stream->scored = stream->corpus->count;
+}
+
+void fzf_stream_push(fzf_stream_t *stream, const char **items,
+                     const size_t *lens, size_t n, fzf_slab_t *slab) {
+  for (size_t i = 0; i < n; i++) {
+    size_t len = lens ? lens[i] : strlen(items[i]);
+    fzf_corpus_append(stream->corpus, items[i], len);
+  }
+  fzf_stream_update(stream, slab);
+}
+
+/* Every item matching `next` also matches `prev` if `next` only appends to
+ * `prev`, as long as nothing that broadens the result is involved: or, inverse
+ * and suffix terms or escaped spaces changing how terms are split */
+static bool prompt_narrows(const char *prev, const char *next) {
+  size_t prev_len = strlen(prev);
+  return strncmp(prev, next, prev_len) == 0 && strpbrk(next, "|!$\\") == NULL;
+}
+
+static void stream_rescore_matched(fzf_stream_t *stream, fzf_slab_t *slab) {
+  fzf_matches_t prev = stream->matched;
+  fzf_matches_init(&stream->matched);
+  stream->top.size = 0;
+  rows_begin(stream);
+  for (size_t i = 0; i < prev.size; i++) {
+    stream_score(stream, prev.data[i].idx, slab);
+  }
+  rows_end(stream);
+  fzf_matches_free(&prev);
+}
+
+static void stream_compile(fzf_stream_t *stream, const char *prompt) {
+  char *copy = strdup(prompt);
+  SFREE(stream->prompt);
+  stream->prompt = copy;
+  fzf_free_pattern(stream->pattern);
+  // fzf_parse_pattern modifies its input
+  char *tmp = strdup(prompt);
+  stream->pattern =
+      parse_pattern(stream->case_mode, stream->normalize, tmp, stream->fuzzy);
+  free(tmp);
+  fzf_pattern_set_nth(stream->pattern, stream->delimiter, stream->nth);
+}
+
+static void stream_rescore_all(fzf_stream_t *stream, fzf_slab_t *slab) {
+  stream->top.size = 0;
+  stream->matched.size = 0;
+  rows_begin(stream);
+  for (size_t i = 0; i < stream->scored; i++) {
+    stream_score(stream, i, slab);
+  }
+  rows_end(stream);
+}
+
+void fzf_stream_set_prompt(fzf_stream_t *stream, const char *prompt,
+                           fzf_slab_t *slab) {
+  bool narrow = prompt_narrows(stream->prompt, prompt);
+  stream_compile(stream, prompt);
+
+  if (narrow) {
+    stream_rescore_matched(stream, slab);
+  } else {
+    stream_rescore_all(stream, slab);
+  }
+  fzf_stream_update(stream, slab);
+}
+
+bool fzf_stream_set_nth(fzf_stream_t *stream, char delimiter, const char *nth,
+                        fzf_slab_t *slab) {
+  // validate before touching the stream
+  fzf_pattern_t check;
+  memset(&check, 0, sizeof(check));
+  if (!fzf_pattern_set_nth(&check, delimiter, nth)) {
+    return false;
+  }
+  SFREE(stream->nth);
+  stream->nth = nth ? strdup(nth) : NULL;
+  stream->delimiter = delimiter;
+  fzf_pattern_set_nth(stream->pattern, delimiter, nth);
+  stream_rescore_all(stream, slab);
+  fzf_stream_update(stream, slab);
+  return true;
+}
+
+void fzf_stream_set_blend(fzf_stream_t *stream, const fzf_blend_t *blend,
+                          fzf_slab_t *slab) {
+  if (blend) {
+    stream->blend = *blend;
+  } else {
+    memset(&stream->blend, 0, sizeof(stream->blend));
+  }
+  // blending only reorders, the set of matches stays the same
+  stream_rescore_matched(stream, slab);
+}
+
+fzf_corpus_t *fzf_stream_corpus(fzf_stream_t *stream) {
+  return stream->corpus;
+}
+
+size_t fzf_stream_matched(fzf_stream_t *stream) {
+  return stream->matched.size;
+}
+
+const fzf_matches_t *fzf_stream_top(fzf_stream_t *stream) {
+  fzf_matches_t *sorted = &stream->sorted;
+  sorted->size = 0;
+  for (size_t i = 0; i < stream->top.size; i++) {
+    append_match(sorted, stream->top.data[i]);
+  }
+  heap_sort(stream->corpus->lens, sorted);
+  return sorted;
+}
+
+const fzf_matches_t *fzf_stream_all(fzf_stream_t *stream) {
+  fzf_matches_t *sorted = &stream->sorted;
+  sorted->size = 0;
+  for (size_t i = 0; i < stream->matched.size; i++) {
+    append_match(sorted, stream->matched.data[i]);
+  }
+  fzf_sort_matches(stream->corpus, sorted);
+  return sorted;
+}
+
+fzf_result_buf_t *fzf_stream_result(fzf_stream_t *stream, bool all,
+                                    bool ranges, fzf_slab_t *slab) {
+  const fzf_matches_t *matches =
+      all ? fzf_stream_all(stream) : fzf_stream_top(stream);
+  return fzf_make_result_buf(stream->corpus, matches,
+                             ranges ? stream->pattern : NULL, slab);
+}
+
+/* Threads */
+#ifdef _WIN32
+typedef HANDLE thread_t;
+typedef SRWLOCK mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#define COND_INITIALIZER CONDITION_VARIABLE_INIT
+
+typedef struct {
+  void *(*fn)(void *);
+  void *arg;
+} thread_start_t;
+
+static DWORD WINAPI thread_trampoline(LPVOID data) {
+  thread_start_t start = *(thread_start_t *)data;
+  free(data);
+  start.fn(start.arg);
+  return 0;
+}
+
+static void thread_create(thread_t *thread, void *(*fn)(void *), void *arg) {
+  thread_start_t *start = (thread_start_t *)malloc(sizeof(thread_start_t));
+  start->fn = fn;
+  start->arg = arg;
+  *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+}
+
+static void thread_join(thread_t thread) {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+static void mutex_lock(mutex_t *mutex) {
+  AcquireSRWLockExclusive(mutex);
+}
+
+static void mutex_unlock(mutex_t *mutex) {
+  ReleaseSRWLockExclusive(mutex);
+}
+
+static void cond_wait(cond_t *cond, mutex_t *mutex) {
+  SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static void cond_broadcast(cond_t *cond) {
+  WakeAllConditionVariable(cond);
+}
+
+static size_t cpu_count(void) {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (size_t)info.dwNumberOfProcessors;
+}
+#else
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER PTHREAD_COND_INITIALIZER
+
+static void thread_create(thread_t *thread, void *(*fn)(void *), void *arg) {
+  pthread_create(thread, NULL, fn, arg);
+}
+
+static void thread_join(thread_t thread) {
+  pthread_join(thread, NULL);
+}
+
+static void mutex_lock(mutex_t *mutex) {
+  pthread_mutex_lock(mutex);
+}
+
+static void mutex_unlock(mutex_t *mutex) {
+  pthread_mutex_unlock(mutex);
+}
+
+static void cond_wait(cond_t *cond, mutex_t *mutex) {
+  pthread_cond_wait(cond, mutex);
+}
+
+static void cond_broadcast(cond_t *cond) {
+  pthread_cond_broadcast(cond);
+}
+
+static size_t cpu_count(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (size_t)count : 1;
+}
+#endif
+
+/* Slab pool
+ *
+ * Every thread caches the slab it released last, so acquiring again gets warm
+ * memory. Further releases go to a shared free list, which also takes over the
+ * cached slab of an exiting thread. Slabs made with another config than the
+ * current one of the pool are freed instead of handed out. */
+#define SLAB_POOL_MAX 16
+
+static struct {
+  mutex_t mutex;
+  fzf_slab_t *free[SLAB_POOL_MAX];
+  size_t size;
+  bool configured;
+  fzf_slab_config_t config;
+} slab_pool = {.mutex = MUTEX_INITIALIZER};
+
+/* must hold slab_pool.mutex */
+static bool slab_pool_fits(fzf_slab_t *slab) {
+  fzf_slab_config_t config =
+      slab_pool.configured ? slab_pool.config : default_slab_config;
+  return slab->config.size_16 == config.size_16 &&
+         slab->config.size_32 == config.size_32 &&
+         slab->config.auto_size == config.auto_size &&
+         slab->config.huge_pages == config.huge_pages;
+}
+
+static void slab_pool_put(fzf_slab_t *slab) {
+  mutex_lock(&slab_pool.mutex);
+  if (slab_pool.size < SLAB_POOL_MAX) {
+    slab_pool.free[slab_pool.size++] = slab;
+    slab = NULL;
+  }
+  mutex_unlock(&slab_pool.mutex);
+  fzf_free_slab(slab);
+}
+
+#ifdef _WIN32
+static DWORD slab_key;
+static INIT_ONCE slab_key_once = INIT_ONCE_STATIC_INIT;
+
+static void WINAPI slab_key_destroy(void *slab) {
+  if (slab) {
+    slab_pool_put((fzf_slab_t *)slab);
+  }
+}
+
+static BOOL CALLBACK slab_key_init(PINIT_ONCE once, void *param, void **ctx) {
+  slab_key = FlsAlloc(slab_key_destroy);
+  return TRUE;
+}
+
+static fzf_slab_t *local_slab(void) {
+  InitOnceExecuteOnce(&slab_key_once, slab_key_init, NULL, NULL);
+  return (fzf_slab_t *)FlsGetValue(slab_key);
+}
+
+static void set_local_slab(fzf_slab_t *slab) {
+  FlsSetValue(slab_key, slab);
+}
+#else
+static pthread_key_t slab_key;
+static pthread_once_t slab_key_once = PTHREAD_ONCE_INIT;
+
+static void slab_key_destroy(void *slab) {
+  slab_pool_put((fzf_slab_t *)slab);
+}
+
+static void slab_key_init(void) {
+  pthread_key_create(&slab_key, slab_key_destroy);
+}
+
+static fzf_slab_t *local_slab(void) {
+  pthread_once(&slab_key_once, slab_key_init);
+  return (fzf_slab_t *)pthread_getspecific(slab_key);
+}
+
+static void set_local_slab(fzf_slab_t *slab) {
+  pthread_setspecific(slab_key, slab);
+}
+#endif
+
+fzf_slab_t *fzf_acquire_slab(void) {
+  fzf_slab_t *slab = local_slab();
+  set_local_slab(NULL);
+  mutex_lock(&slab_pool.mutex);
+  if (slab && !slab_pool_fits(slab)) {
+    fzf_free_slab(slab);
+    slab = NULL;
+  }
+  while (slab == NULL && slab_pool.size > 0) {
+    slab = slab_pool.free[--slab_pool.size];
+    if (!slab_pool_fits(slab)) {
+      fzf_free_slab(slab);
+      slab = NULL;
+    }
+  }
+  fzf_slab_config_t config =
+      slab_pool.configured ? slab_pool.config : default_slab_config;
+  mutex_unlock(&slab_pool.mutex);
+  return slab ? slab : fzf_make_slab(config);
+}
+
+void fzf_set_slab_pool_config(fzf_slab_config_t config) {
+  mutex_lock(&slab_pool.mutex);
+  slab_pool.config = config;
+  slab_pool.configured = true;
+  mutex_unlock(&slab_pool.mutex);
+}
+
+void fzf_release_slab(fzf_slab_t *slab) {
+  if (slab == NULL) {
+    return;
+  }
+  // the next owner shouldn't see our counters
+  fzf_disable_stats(slab);
+  if (local_slab() == NULL) {
+    set_local_slab(slab);
+  } else {
+    slab_pool_put(slab);
+  }
+}
+
+void fzf_clear_slab_pool(void) {
+  fzf_free_slab(local_slab());
+  set_local_slab(NULL);
+  mutex_lock(&slab_pool.mutex);
+  for (size_t i = 0; i < slab_pool.size; i++) {
+    fzf_free_slab(slab_pool.free[i]);
+  }
+  slab_pool.size = 0;
+  mutex_unlock(&slab_pool.mutex);
+}
+
+/* Scheduler and background jobs
+ *
+ * One process wide pool of worker threads, each owning a slab, scores the
+ * jobs of every picker. Jobs are split into chunks and workers always take
+ * the next chunk of the most important job: highest priority first, newest
+ * first among equal priorities. A new job therefore preempts older or
+ * background work as soon as the running chunks are done. Submitting a job
+ * for an owner cancels the stale jobs of that owner. */
+#define JOB_CHUNK_SIZE 1024
+#define SCHEDULER_MAX_THREADS 8
+
+struct fzf_job_s {
+  fzf_corpus_t *corpus;
+  fzf_pattern_t *pattern;
+  size_t k;
+  int32_t priority;
+  uint64_t owner;
+  uint64_t seq;
+  size_t chunks;
+  size_t next_chunk;
+  size_t done_chunks;
+  size_t active;
+  uint64_t cancelled;
+  bool queued;
+  fzf_matches_t result;
+  size_t matched;
+  fzf_job_t *next;
+};
+
+typedef struct {
+  thread_t thread;
+  fzf_slab_t *slab;
+  fzf_matches_t top;
+} sched_worker_t;
+
+static struct {
+  mutex_t mutex;
+  cond_t work;
+  cond_t done;
+  bool running;
+  bool shutdown;
+  size_t thread_count;
+  sched_worker_t *workers;
+  fzf_job_t *queue;
+  uint64_t seq;
+} sched = {.mutex = MUTEX_INITIALIZER,
+           .work = COND_INITIALIZER,
+           .done = COND_INITIALIZER};
+
+static bool job_finished(fzf_job_t *job) {
+  return job->active == 0 &&
+         (job->done_chunks == job->chunks || atomic_load64(&job->cancelled));
+}
+
+/* must hold sched.mutex */
+static void sched_unqueue(fzf_job_t *job) {
+  for (fzf_job_t **it = &sched.queue; *it; it = &(*it)->next) {
+    if (*it == job) {
+      *it = job->next;
+      job->next = NULL;
+      job->queued = false;
+      return;
+    }
+  }
+}
+
+/* must hold sched.mutex */
+static fzf_job_t *sched_pick(void) {
+  fzf_job_t *best = NULL;
+  fzf_job_t *it = sched.queue;
+  while (it) {
+    fzf_job_t *next = it->next;
+    if (atomic_load64(&it->cancelled) || it->next_chunk == it->chunks) {
+      sched_unqueue(it);
+    } else if (!best || it->priority > best->priority ||
+               (it->priority == best->priority && it->seq > best->seq)) {
+      best = it;
+    }
+    it = next;
+  }
+  return best;
+}
+
+static void *sched_worker_run(void *data) {
+  sched_worker_t *worker = (sched_worker_t *)data;
+  worker->slab = fzf_acquire_slab();
+  mutex_lock(&sched.mutex);
+  for (;;) {
+    fzf_job_t *job = sched_pick();
+    if (sched.shutdown) {
+      break;
+    }
+    if (!job) {
+      cond_wait(&sched.work, &sched.mutex);
+      continue;
+    }
+    size_t chunk = job->next_chunk++;
+    job->active++;
+    mutex_unlock(&sched.mutex);
+
+    size_t matched = 0;
+    worker->top.size = 0;
+    size_t end = min64u((chunk + 1) * JOB_CHUNK_SIZE, job->corpus->count);
+    for (size_t i = chunk * JOB_CHUNK_SIZE; i < end; i++) {
+      int32_t score =
+          corpus_score(job->corpus, i, job->pattern, NULL, worker->slab);
+      if (score > 0) {
+        matched++;
+        heap_push(job->corpus->lens, &worker->top, job->k,
+                  (fzf_match_t){.idx = (uint32_t)i, .score = score});
+      }
+    }
+
+    mutex_lock(&sched.mutex);
+    job->matched += matched;
+    for (size_t i = 0; i < worker->top.size; i++) {
+      heap_push(job->corpus->lens, &job->result, job->k, worker->top.data[i]);
+    }
+    job->done_chunks++;
+    job->active--;
+    if (job_finished(job)) {
+      if (!atomic_load64(&job->cancelled)) {
+        heap_sort(job->corpus->lens, &job->result);
+      }
+      cond_broadcast(&sched.done);
+    }
+  }
+  mutex_unlock(&sched.mutex);
+  // kept warm for the workers of the next start
+  fzf_release_slab(worker->slab);
+  worker->slab = NULL;
+  return NULL;
+}
+
+/* must hold sched.mutex */
+static void sched_start(void) {
+  if (sched.running) {
+    return;
+  }
+  if (sched.thread_count == 0) {
+    sched.thread_count = min64u(cpu_count(), SCHEDULER_MAX_THREADS);
+  }
+  sched.shutdown = false;
+  sched.workers =
+      (sched_worker_t *)malloc(sched.thread_count * sizeof(sched_worker_t));
+  memset(sched.workers, 0, sched.thread_count * sizeof(sched_worker_t));
+  for (size_t i = 0; i < sched.thread_count; i++) {
+    thread_create(&sched.workers[i].thread, sched_worker_run,
+                  &sched.workers[i]);
+  }
+  sched.running = true;
+}
+
+void fzf_scheduler_init(size_t threads) {
+  mutex_lock(&sched.mutex);
+  if (!sched.running) {
+    sched.thread_count = threads;
+  }
+  mutex_unlock(&sched.mutex);
+}
+
+void fzf_scheduler_shutdown(void) {
+  mutex_lock(&sched.mutex);
+  if (!sched.running) {
+    mutex_unlock(&sched.mutex);
+    return;
+  }
+  sched.shutdown = true;
+  for (fzf_job_t *it = sched.queue; it; it = it->next) {
+    atomic_store64(&it->cancelled, 1);
+  }
+  cond_broadcast(&sched.work);
+  mutex_unlock(&sched.mutex);
+
+  for (size_t i = 0; i < sched.thread_count; i++) {
+    thread_join(sched.workers[i].thread);
+    fzf_matches_free(&sched.workers[i].top);
+  }
+
+  mutex_lock(&sched.mutex);
+  free(sched.workers);
+  sched.workers = NULL;
+  sched.running = false;
+  cond_broadcast(&sched.done);
+  mutex_unlock(&sched.mutex);
+}
+
+size_t fzf_scheduler_threads(void) {
+  mutex_lock(&sched.mutex);
+  size_t threads = sched.running ? sched.thread_count : 0;
+  mutex_unlock(&sched.mutex);
+  return threads;
+}
+
+fzf_job_t *fzf_submit_job(fzf_corpus_t *corpus, const char *prompt,
+                          fzf_case_types case_mode, bool normalize, bool fuzzy,
+                          size_t k, int32_t priority, uint64_t owner) {
+  fzf_job_t *job = (fzf_job_t *)malloc(sizeof(fzf_job_t));
+  memset(job, 0, sizeof(*job));
+  job->corpus = corpus;
+  {
+    // fzf_parse_pattern modifies its input
+    char *tmp = strdup(prompt);
+    job->pattern = parse_pattern(case_mode, normalize, tmp, fuzzy);
+    free(tmp);
+  }
+  job->k = k;
+  job->priority = priority;
+  job->owner = owner;
+  job->chunks = (corpus->count + JOB_CHUNK_SIZE - 1) / JOB_CHUNK_SIZE;
+
+  mutex_lock(&sched.mutex);
+  sched_start();
+  if (owner != 0) {
+    for (fzf_job_t *it = sched.queue; it; it = it->next) {
+      if (it->owner == owner) {
+        atomic_store64(&it->cancelled, 1);
+      }
+    }
+  }
+  job->seq = ++sched.seq;
+  if (job->chunks > 0) {
+    job->next = sched.queue;
+    job->queued = true;
+    sched.queue = job;
+    cond_broadcast(&sched.work);
+  }
+  mutex_unlock(&sched.mutex);
+  return job;
+}
+
+fzf_job_state fzf_job_poll(fzf_job_t *job) {
+  if (atomic_load64(&job->cancelled)) {
+    return JobCancelled;
+  }
+  mutex_lock(&sched.mutex);
+  bool finished = job_finished(job);
+  mutex_unlock(&sched.mutex);
+  return finished ? JobDone : JobRunning;
+}
+
+/* waits until no worker touches the job anymore */
+static void job_wait(fzf_job_t *job) {
+  mutex_lock(&sched.mutex);
+  while (!job_finished(job) && sched.running) {
+    cond_wait(&sched.done, &sched.mutex);
+  }
+  if (job->queued) {
+    sched_unqueue(job);
+  }
+  mutex_unlock(&sched.mutex);
+}
+
+const fzf_matches_t *fzf_job_collect(fzf_job_t *job) {
+  job_wait(job);
+  if (atomic_load64(&job->cancelled)) {
+    return NULL;
+  }
+  return &job->result;
+}
+
+fzf_result_buf_t *fzf_job_result(fzf_job_t *job) {
+  const fzf_matches_t *matches = fzf_job_collect(job);
+  if (matches == NULL) {
+    return NULL;
+  }
+  return fzf_make_result_buf(job->corpus, matches, NULL, NULL);
+}
+
+size_t fzf_job_matched(fzf_job_t *job) {
+  job_wait(job);
+  return job->matched;
+}
+
+void fzf_job_cancel(fzf_job_t *job) {
+  atomic_store64(&job->cancelled, 1);
+}
+
+void fzf_free_job(fzf_job_t *job) {
+  if (job) {
+    fzf_job_cancel(job);
+    job_wait(job);
+    fzf_matches_free(&job->result);
+    fzf_free_pattern(job->pattern);
+    free(job);
+  }
+}
@@ -32,15 +32,40 @@ typedef struct {
 } fzf_result_t;
 
 typedef struct {
-  fzf_i16_t I16;
-  fzf_i32_t I32;
-} fzf_slab_t;
+  uint64_t fuzzy_v1_calls;
+  uint64_t fuzzy_v2_calls;
+  uint64_t exact_calls;
+  uint64_t prefix_calls;
+  uint64_t suffix_calls;
+  uint64_t equal_calls;
+  uint64_t prefilter_rejects;
+  uint64_t v1_fallbacks;
+  uint64_t heap_allocs16;
+  uint64_t heap_allocs32;
+  uint64_t bytes_scanned;
+  uint64_t bound_prunes;
+  uint64_t slab_grows;
+  uint64_t trie_shared_bytes;
+  uint64_t cached_rows;
+} fzf_stats_t;
 
 typedef struct {
   size_t size_16;
   size_t size_32;
+  /* grow the buffers to what the longest item needs instead of falling back
+   * to fzf_fuzzy_match_v1 or allocating */
+  bool auto_size;
+  /* back large buffers with transparent huge pages (linux only) */
+  bool huge_pages;
 } fzf_slab_config_t;
 
+typedef struct {
+  fzf_i16_t I16;
+  fzf_i32_t I32;
+  fzf_stats_t *stats;
+  fzf_slab_config_t config;
+} fzf_slab_t;
+
 typedef struct {
   const char *data;
   size_t size;
@@ -49,6 +74,10 @@ typedef struct {
 typedef fzf_result_t (*fzf_algo_t)(bool, bool, fzf_string_t *, fzf_string_t *,
                                    fzf_position_t *, fzf_slab_t *);
 
+/* fzf_algo_t instance for one case, matching normalized text */
+typedef fzf_result_t (*fzf_matcher_t)(fzf_string_t *, fzf_string_t *,
+                                      fzf_position_t *, fzf_slab_t *);
+
 typedef enum { CaseSmart = 0, CaseIgnore, CaseRespect } fzf_case_types;
 
 typedef struct {
@@ -57,19 +86,61 @@ typedef struct {
   char *ptr;
   void *text;
   bool case_sensitive;
+  uint64_t mask;
+  /* fn specialized for case_sensitive, what matching calls */
+  fzf_matcher_t match;
 } fzf_term_t;
 
+typedef enum {
+  ProbeParsePattern = 0,
+  ProbeGetScore,
+  ProbeGetPositions,
+  ProbeLast
+} fzf_probe_types;
+
+#define FZF_HIST_BUCKETS 64
+
+/* bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds */
+typedef struct {
+  uint64_t buckets[FZF_HIST_BUCKETS];
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+} fzf_histogram_t;
+
+/* called on entry (enter = true, elapsed_ns = 0) and exit of each probe. text
+ * is the prompt for ProbeParsePattern and the item otherwise */
+typedef void (*fzf_trace_fn)(void *data, fzf_probe_types probe, bool enter,
+                             const char *text, uint64_t elapsed_ns);
+
 typedef struct {
   fzf_term_t *ptr;
   size_t size;
   size_t cap;
 } fzf_term_set_t;
 
+#define FZF_MAX_NTH 8
+
+/* a range of fields like fzf's --nth. Indices are 1 based, negative ones count
+ * from the last field and 0 leaves that side of the range open */
+typedef struct {
+  int32_t begin;
+  int32_t end;
+} fzf_field_range_t;
+
 typedef struct {
   fzf_term_set_t **ptr;
   size_t size;
   size_t cap;
   bool only_inv;
+  /* terms only match the selected fields, see fzf_pattern_set_nth */
+  char delimiter;
+  fzf_field_range_t nth[FZF_MAX_NTH];
+  size_t nth_size;
+  /* unique per parsed pattern and nth, keys fzf_match_cache_t */
+  uint64_t id;
+  /* terms are normalized and match items normalized, see fzf_parse_pattern */
+  bool normalize;
 } fzf_pattern_t;
 
 fzf_result_t fzf_fuzzy_match_v1(bool case_sensitive, bool normalize,
@@ -91,10 +162,189 @@ fzf_result_t fzf_equal_match(bool case_sensitive, bool normalize,
                              fzf_string_t *text, fzf_string_t *pattern,
                              fzf_position_t *pos, fzf_slab_t *slab);
 
+/* content hash deduplication, every distinct item is stored once */
+typedef struct {
+  /* open addressing, hash << 32 | (item index + 1), 0 marks a free slot */
+  uint64_t *table;
+  size_t table_cap;
+  /* distinct item of every appended item */
+  uint32_t *origins;
+  size_t inputs;
+  size_t origins_cap;
+  /* appended items of every distinct item, built on first use */
+  uint32_t *fanout_offsets;
+  uint32_t *fanout;
+  size_t fanout_inputs;
+} fzf_dedup_t;
+
+/* normalized copies of the items that change when normalized */
+typedef struct {
+  char *data;
+  size_t size;
+  size_t cap;
+  /* copy of every item plus one, 0 if the item doesn't change */
+  uint32_t *slots;
+  size_t slots_cap;
+  size_t *offsets;
+  uint32_t *lens;
+  uint64_t *masks;
+  size_t count;
+  size_t items_cap;
+} fzf_normalized_t;
+
+/* the items in byte order, each sharing `shared` bytes with the one before.
+ * Walking it depth first visits the trie of all items */
+typedef struct {
+  uint32_t *order;
+  uint32_t *shared;
+  size_t count;
+  size_t max_len;
+} fzf_trie_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t cap;
+  size_t *offsets;
+  uint32_t *lens;
+  /* bytes present in each item, see fzf_char_mask */
+  uint64_t *masks;
+  /* offset of the file name in each item, NULL unless basename first */
+  uint32_t *basenames;
+  size_t count;
+  size_t items_cap;
+  /* read only mapping holding the items, for an index also the tables */
+  char *map;
+  size_t map_size;
+  bool mapped_tables;
+  fzf_dedup_t *dedup;
+  fzf_normalized_t *normalized;
+  fzf_trie_t *trie;
+} fzf_corpus_t;
+
+/* items in byte order, front coded: each one stores the length of the prefix
+ * it shares with the one before and the rest. Every FZF_FC_BLOCK items a
+ * restart point stores the whole item so any item decodes from there */
+#define FZF_FC_BLOCK 16
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+  /* offset of every block in data */
+  size_t *restarts;
+  /* corpus index of the items in byte order, and the other way around */
+  uint32_t *origins;
+  uint32_t *ranks;
+  /* by corpus index */
+  uint32_t *lens;
+  size_t count;
+  size_t max_len;
+  bool basename_first;
+} fzf_front_coded_t;
+
+typedef struct {
+  uint32_t idx;
+  int32_t score;
+} fzf_match_t;
+
+typedef struct {
+  fzf_match_t *data;
+  size_t size;
+  size_t cap;
+} fzf_matches_t;
+
+/* results as parallel arrays for zero copy access from luajit. begin and end
+ * are the bounds of the matched bytes and NULL unless requested */
+typedef struct {
+  size_t size;
+  uint32_t *idx;
+  int32_t *score;
+  uint32_t *begin;
+  uint32_t *end;
+  uint64_t refs;
+} fzf_result_buf_t;
+
+typedef enum { BlendAdd = 0, BlendScale } fzf_blend_types;
+
+/* external per item weights (e.g. frecency) blended into the score of every
+ * match. BlendAdd ranks by score + factor * weight, BlendScale by
+ * score * (1 + factor * weight). Items at or past count weigh 0 and a match
+ * always keeps a score of at least 1 */
+typedef struct {
+  const float *weights;
+  size_t count;
+  fzf_blend_types mode;
+  float factor;
+} fzf_blend_t;
+
+/* the last v2 matrix row (h, then c) of the prompt term for every match of
+ * a stream, from the first column the row can match to the end of the item */
+typedef struct {
+  int16_t *data;
+  size_t size;
+  size_t cap;
+  /* offset of the row of each item in data, SIZE_MAX without one */
+  size_t *offsets;
+  uint32_t *starts;
+  size_t items_cap;
+  /* the term the rows belong to, NULL if the prompt can't use them */
+  char *term;
+  size_t term_size;
+  bool case_sensitive;
+  int16_t *scratch;
+  size_t scratch_cap;
+} fzf_row_cache_t;
+
+typedef struct {
+  fzf_corpus_t *corpus;
+  fzf_case_types case_mode;
+  bool normalize;
+  bool fuzzy;
+  size_t k;
+  char *prompt;
+  fzf_pattern_t *pattern;
+  fzf_matches_t matched;
+  fzf_matches_t top;
+  fzf_matches_t sorted;
+  size_t scored;
+  fzf_blend_t blend;
+  char delimiter;
+  char *nth;
+  /* rows of the current and the previous prompt, NULL unless enabled */
+  fzf_row_cache_t *rows;
+  fzf_row_cache_t *prev_rows;
+} fzf_stream_t;
+
+typedef enum { JobRunning = 0, JobDone, JobCancelled } fzf_job_state;
+
+typedef struct fzf_job_s fzf_job_t;
+
+typedef struct {
+  bool hidden;
+  const char **ignore;
+  size_t ignore_count;
+  size_t threads;
+} fzf_walk_opts_t;
+
+typedef struct fzf_walker_s fzf_walker_t;
+
+typedef struct fzf_match_cache_s fzf_match_cache_t;
+
 /* interface */
+/* a pattern parsed with normalize matches Latin letters as their ASCII letter
+ * (e.g. "cafe" finds "café") in every function it is passed to. Items are
+ * normalized on each call unless they are kept normalized, see
+ * fzf_corpus_normalize and fzf_normalize_text */
 fzf_pattern_t *fzf_parse_pattern(fzf_case_types case_mode, bool normalize,
                                  char *pattern, bool fuzzy);
 void fzf_free_pattern(fzf_pattern_t *pattern);
+/* restricts matching to fields of each item, nth uses the syntax of fzf's
+ * --nth (e.g. "1", "-1", "2..", "1,3..-2"). Fields end after each delimiter,
+ * with delimiter 0 they are separated by whitespace. Every term is matched
+ * against each selected field on its own and the best field counts. A NULL
+ * nth matches whole items again, an invalid one returns false */
+bool fzf_pattern_set_nth(fzf_pattern_t *pattern, char delimiter,
+                         const char *nth);
 
 int32_t fzf_get_score(const char *text, fzf_pattern_t *pattern,
                       fzf_slab_t *slab);
@@ -103,9 +353,235 @@ fzf_position_t *fzf_pos_array(size_t len);
 fzf_position_t *fzf_get_positions(const char *text, fzf_pattern_t *pattern,
                                   fzf_slab_t *slab);
 void fzf_free_positions(fzf_position_t *pos);
+/* score and positions of one item in a single pass. Returns NULL and sets
+ * score to 0 if the item doesn't match */
+fzf_position_t *fzf_get_match(const char *text, fzf_pattern_t *pattern,
+                              fzf_slab_t *slab, int32_t *score);
+
+/* writes text with every Latin letter replaced by its ASCII letter to out, at
+ * most len bytes, and returns the new length, which is len only if nothing
+ * changed. Callers that keep items normalized once match them with a pattern
+ * parsed from the normalized prompt without normalize, and map positions back
+ * to the original item with fzf_denormalize_positions */
+size_t fzf_normalize_text(const char *text, size_t len, char *out);
+void fzf_denormalize_positions(const char *text, size_t len,
+                               fzf_position_t *pos);
+
+/* keeps the positions of the k best items scored with fzf_cached_score for
+ * the same pattern, so highlighting them with fzf_cached_positions needs no
+ * second run of the matching algorithm */
+fzf_match_cache_t *fzf_make_match_cache(size_t k);
+void fzf_free_match_cache(fzf_match_cache_t *cache);
+int32_t fzf_cached_score(fzf_match_cache_t *cache, const char *text,
+                         fzf_pattern_t *pattern, fzf_slab_t *slab);
+/* like fzf_get_positions, copied from the cache if text is one of the best */
+fzf_position_t *fzf_cached_positions(fzf_match_cache_t *cache, const char *text,
+                                     fzf_pattern_t *pattern, fzf_slab_t *slab);
 
 fzf_slab_t *fzf_make_slab(fzf_slab_config_t config);
 fzf_slab_t *fzf_make_default_slab(void);
 void fzf_free_slab(fzf_slab_t *slab);
+/* pooled slabs: acquire reuses the slab the calling thread released last, or
+ * one released by another thread, and only makes a new default slab if the
+ * pool is empty. Release keeps the slab for the next acquire */
+fzf_slab_t *fzf_acquire_slab(void);
+void fzf_release_slab(fzf_slab_t *slab);
+/* config of the slabs the pool hands out, default slabs until set */
+void fzf_set_slab_pool_config(fzf_slab_config_t config);
+/* frees the pooled slabs and the one cached by the calling thread */
+void fzf_clear_slab_pool(void);
+
+/* corpus: items stored natively so they can be scored in batches */
+fzf_corpus_t *fzf_make_corpus(void);
+void fzf_free_corpus(fzf_corpus_t *corpus);
+void fzf_corpus_append(fzf_corpus_t *corpus, const char *item, size_t len);
+size_t fzf_corpus_count(fzf_corpus_t *corpus);
+/* items are not NUL terminated if the corpus was loaded from a file */
+const char *fzf_corpus_get(fzf_corpus_t *corpus, size_t idx, size_t *len);
+/* maps a newline delimited file (e.g. cached `fd` output), every line becomes
+ * an item that is scored in place. Returns NULL if the file can't be read */
+fzf_corpus_t *fzf_load_corpus(const char *path);
+
+/* path corpora: fuzzy and exact terms are matched against the file name of
+ * each item first and only against the whole path if the file name doesn't
+ * contain them. The file name offsets are kept up to date on append */
+void fzf_corpus_basename_first(fzf_corpus_t *corpus, bool enable);
+
+/* keeps a normalized copy of every item with Latin letters (e.g. "café" as
+ * "cafe"), made once on append. Patterns parsed with normalize match these
+ * copies, positions and ranges still refer to the original items. Without
+ * them such patterns normalize every item on each call, with the same
+ * results. Streams made with normalize keep copies of their corpus */
+void fzf_corpus_normalize(fzf_corpus_t *corpus, bool enable);
+
+/* path corpora share long directory prefixes. With a trie, fzf_score_all and
+ * fzf_top_k run fuzzy terms over the items in byte order and reuse the matrix
+ * columns of the prefix an item shares with the one before, so the work
+ * scales with distinct bytes. Items appended afterwards are scored one by one
+ * until it is enabled again. Fields, basename first and normalized copies
+ * need the whole item and skip the trie */
+void fzf_corpus_path_trie(fzf_corpus_t *corpus, bool enable);
+
+/* front coded copy of a corpus, which can be freed afterwards. Sorted paths
+ * share most of their bytes with the item before, so the copy takes a
+ * fraction of the memory. Items keep the index they have in the corpus. The
+ * batch functions work like the corpus ones: items are decoded into one
+ * buffer while they are scanned and fuzzy terms reuse the matrix columns of
+ * the shared prefix like a path trie. fzf_front_coded_score_all returns the
+ * matches in byte order of the items. Basename first is taken from corpus,
+ * patterns parsed with normalize normalize the items while they are scanned */
+fzf_front_coded_t *fzf_make_front_coded(fzf_corpus_t *corpus);
+void fzf_free_front_coded(fzf_front_coded_t *fc);
+size_t fzf_front_coded_count(fzf_front_coded_t *fc);
+/* bytes of the encoded items and tables */
+size_t fzf_front_coded_bytes(fzf_front_coded_t *fc);
+/* writes item idx to buf, truncated to cap - 1 bytes and NUL terminated.
+ * Returns the length of the item */
+size_t fzf_front_coded_get(fzf_front_coded_t *fc, size_t idx, char *buf,
+                           size_t cap);
+void fzf_front_coded_score_all(fzf_front_coded_t *fc, fzf_pattern_t *pattern,
+                               fzf_slab_t *slab, const fzf_blend_t *blend,
+                               fzf_matches_t *out);
+void fzf_front_coded_top_k(fzf_front_coded_t *fc, fzf_pattern_t *pattern,
+                           fzf_slab_t *slab, const fzf_blend_t *blend,
+                           size_t k, fzf_matches_t *out);
+
+/* a corpus that stores and scores identical items once. Item indices refer to
+ * distinct items, fzf_corpus_fanout returns the appended items (by append
+ * order) behind one of them and fzf_expand_matches replaces every match by
+ * one match per appended item. Indexes only store the distinct items */
+fzf_corpus_t *fzf_make_dedup_corpus(void);
+/* amount of appended items, fzf_corpus_count without deduplication */
+size_t fzf_corpus_inputs(fzf_corpus_t *corpus);
+const uint32_t *fzf_corpus_fanout(fzf_corpus_t *corpus, size_t idx,
+                                  size_t *n);
+/* bit set of the (case folded) bytes in text. An item can only match a term
+ * if its mask contains the mask of the term */
+uint64_t fzf_char_mask(const char *text, size_t len);
+
+/* persistent index: writes items and per item tables of a corpus to path,
+ * keyed by root (a directory or the file the corpus was built from). Loading
+ * maps the file read only and returns NULL if it is missing, was written by
+ * another version or if the device, inode, mtime or size of root changed */
+bool fzf_save_index(fzf_corpus_t *corpus, const char *path, const char *root);
+fzf_corpus_t *fzf_load_index(const char *path, const char *root);
+
+/* batch scoring. Both functions clear `out` before filling it. fzf_score_all
+ * returns every match in index order, fzf_top_k the best k matches ordered by
+ * score, length and index. blend can be NULL */
+void fzf_matches_init(fzf_matches_t *matches);
+void fzf_matches_free(fzf_matches_t *matches);
+void fzf_score_all(fzf_corpus_t *corpus, fzf_pattern_t *pattern,
+                   fzf_slab_t *slab, const fzf_blend_t *blend,
+                   fzf_matches_t *out);
+void fzf_top_k(fzf_corpus_t *corpus, fzf_pattern_t *pattern, fzf_slab_t *slab,
+               const fzf_blend_t *blend, size_t k, fzf_matches_t *out);
+/* orders matches like fzf_top_k with a radix sort. Matches with the same
+ * score and length keep their order, the index order of fzf_score_all */
+void fzf_sort_matches(fzf_corpus_t *corpus, fzf_matches_t *matches);
+/* clears `out` and fills it with the matches of every appended item, in the
+ * order of `matches`. Copies matches for a corpus without deduplication */
+void fzf_expand_matches(fzf_corpus_t *corpus, const fzf_matches_t *matches,
+                        fzf_matches_t *out);
+
+/* copies matches into a reference counted result buffer, starting with one
+ * reference. Pass a pattern to fill begin and end */
+fzf_result_buf_t *fzf_make_result_buf(fzf_corpus_t *corpus,
+                                      const fzf_matches_t *matches,
+                                      fzf_pattern_t *pattern,
+                                      fzf_slab_t *slab);
+fzf_result_buf_t *fzf_retain_result_buf(fzf_result_buf_t *buf);
+void fzf_release_result_buf(fzf_result_buf_t *buf);
+
+/* streaming: items arrive in chunks while the prompt changes. Every chunk is
+ * scored against the current prompt and merged into the top k, a prompt that
+ * only narrows the previous one is scored against the previous matches.
+ * Prompts are parsed with normalize, which keeps the corpus normalized */
+fzf_stream_t *fzf_make_stream(fzf_case_types case_mode, bool normalize,
+                              bool fuzzy, size_t k);
+void fzf_free_stream(fzf_stream_t *stream);
+void fzf_stream_push(fzf_stream_t *stream, const char **items,
+                     const size_t *lens, size_t n, fzf_slab_t *slab);
+void fzf_stream_set_prompt(fzf_stream_t *stream, const char *prompt,
+                           fzf_slab_t *slab);
+/* copies blend (not the weights, they have to outlive the stream) and
+ * rescores the current matches, NULL turns blending off */
+void fzf_stream_set_blend(fzf_stream_t *stream, const fzf_blend_t *blend,
+                          fzf_slab_t *slab);
+/* fzf_pattern_set_nth for every prompt of the stream, rescores all items */
+bool fzf_stream_set_nth(fzf_stream_t *stream, char delimiter, const char *nth,
+                        fzf_slab_t *slab);
+/* keeps the last v2 matrix row of every match while the prompt is a single
+ * fuzzy term. A prompt extending that term only computes the rows of the
+ * added chars for each match. Costs two bytes per column for h and c of
+ * every match, twice since the rows of the previous prompt are kept while
+ * the next one is scored. Takes effect with the next prompt */
+void fzf_stream_row_cache(fzf_stream_t *stream, bool enable);
+/* scores items that were appended to stream->corpus directly */
+void fzf_stream_update(fzf_stream_t *stream, fzf_slab_t *slab);
+fzf_corpus_t *fzf_stream_corpus(fzf_stream_t *stream);
+size_t fzf_stream_matched(fzf_stream_t *stream);
+const fzf_matches_t *fzf_stream_top(fzf_stream_t *stream);
+/* every match, ordered. Invalidates the result of fzf_stream_top */
+const fzf_matches_t *fzf_stream_all(fzf_stream_t *stream);
+/* fzf_stream_top (or fzf_stream_all) as a result buffer that stays valid
+ * after the stream changes */
+fzf_result_buf_t *fzf_stream_result(fzf_stream_t *stream, bool all,
+                                    bool ranges, fzf_slab_t *slab);
+
+/* background scoring on a process wide pool of worker threads. Higher
+ * priorities and newer jobs are scored first, submitting a job with a non zero
+ * owner (e.g. one per picker) cancels the previous jobs of that owner. The
+ * corpus must not be modified until the job is freed, normalize it before
+ * submitting jobs with normalize to not normalize items in every job.
+ * Cancelling does not block, workers stop after their current chunk of items */
+void fzf_scheduler_init(size_t threads);
+void fzf_scheduler_shutdown(void);
+size_t fzf_scheduler_threads(void);
+fzf_job_t *fzf_submit_job(fzf_corpus_t *corpus, const char *prompt,
+                          fzf_case_types case_mode, bool normalize, bool fuzzy,
+                          size_t k, int32_t priority, uint64_t owner);
+fzf_job_state fzf_job_poll(fzf_job_t *job);
+const fzf_matches_t *fzf_job_collect(fzf_job_t *job);
+/* fzf_job_collect as a result buffer that outlives the job */
+fzf_result_buf_t *fzf_job_result(fzf_job_t *job);
+size_t fzf_job_matched(fzf_job_t *job);
+void fzf_job_cancel(fzf_job_t *job);
+void fzf_free_job(fzf_job_t *job);
+
+/* parallel directory walker, lists files below root as paths relative to it.
+ * Hidden entries are skipped unless opts.hidden is set, ignore holds fnmatch
+ * patterns matched against entry names, or against the path relative to root
+ * if they contain a slash (e.g. "src/w*.c"), and symlinks are never followed.
+ * threads = 0 uses one thread per cpu, at most 8.
+ * fzf_walk_drain moves everything found so far into a corpus and returns the
+ * number of items, so a stream can be fed while the walk is running. Returns
+ * NULL if root can't be opened. Not available on Windows, where it always
+ * returns NULL */
+fzf_walker_t *fzf_walk_start(const char *root, fzf_walk_opts_t opts);
+size_t fzf_walk_drain(fzf_walker_t *walker, fzf_corpus_t *corpus);
+bool fzf_walk_done(fzf_walker_t *walker);
+void fzf_walk_cancel(fzf_walker_t *walker);
+void fzf_free_walker(fzf_walker_t *walker);
+
+/* hot path counters, collected per slab. Disabled by default, define
+ * FZF_NO_STATS to compile them out completely */
+void fzf_enable_stats(fzf_slab_t *slab);
+void fzf_disable_stats(fzf_slab_t *slab);
+void fzf_reset_stats(fzf_slab_t *slab);
+const fzf_stats_t *fzf_get_stats(fzf_slab_t *slab);
+
+/* process wide latency histograms and tracing around fzf_parse_pattern,
+ * fzf_get_score and fzf_get_positions. Building with FZF_USDT adds static
+ * tracepoints (provider fzf, e.g. get_score_entry/get_score_return). Both
+ * take the text as first argument, return probes take the score, the number
+ * of positions or the number of term sets as second. Calls already running
+ * when timing or the hook is switched on are not recorded */
+void fzf_enable_timing(void);
+void fzf_disable_timing(void);
+void fzf_reset_timing(void);
+void fzf_get_timing(fzf_probe_types probe, fzf_histogram_t *out);
+uint64_t fzf_histogram_percentile(const fzf_histogram_t *hist, double p);
+void fzf_set_trace_hook(fzf_trace_fn fn, void *data);
 
 #endif // FZF_H_
@@ -0,0 +1,341 @@
+#include "fzf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+/* there is no walker on Windows, fzf_walk_start always returns NULL */
+struct fzf_walker_s {
+  int unused;
+};
+
+fzf_walker_t *fzf_walk_start(const char *root, fzf_walk_opts_t opts) {
+  (void)root;
+  (void)opts;
+  return NULL;
+}
+
+size_t fzf_walk_drain(fzf_walker_t *walker, fzf_corpus_t *corpus) {
+  (void)walker;
+  (void)corpus;
+  return 0;
+}
+
+bool fzf_walk_done(fzf_walker_t *walker) {
+  (void)walker;
+  return true;
+}
+
+void fzf_walk_cancel(fzf_walker_t *walker) {
+  (void)walker;
+}
+
+void fzf_free_walker(fzf_walker_t *walker) {
+  (void)walker;
+}
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SFREE(x)                                                               \
+  if (x) {                                                                     \
+    free(x);                                                                   \
+  }
+
+/* Directories are walked by a pool of threads sharing one queue. Every
+ * directory is opened relative to the root with openat, so items are paths
+ * relative to the root just like the output of `fd`. Found files are collected
+ * in a buffer that the caller moves into a corpus with fzf_walk_drain while
+ * the walk is still running. */
+
+/* like the scheduler, more threads mostly contend on the queue */
+#define WALK_MAX_THREADS 8
+
+typedef struct {
+  char **data;
+  size_t size;
+  size_t cap;
+} dir_queue_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t cap;
+  size_t count;
+} path_buffer_t;
+
+struct fzf_walker_s {
+  int root_fd;
+  bool hidden;
+  char **ignore;
+  size_t ignore_count;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  dir_queue_t queue;
+  size_t pending;
+  bool cancelled;
+  path_buffer_t found;
+
+  pthread_t *threads;
+  size_t thread_count;
+};
+
+static void queue_push(dir_queue_t *queue, char *dir) {
+  if (queue->size + 1 > queue->cap) {
+    queue->cap = queue->cap == 0 ? 64 : queue->cap * 2;
+    queue->data = (char **)realloc(queue->data, queue->cap * sizeof(char *));
+  }
+  queue->data[queue->size] = dir;
+  queue->size++;
+}
+
+static void buffer_append(path_buffer_t *buffer, const char *path,
+                          size_t len) {
+  if (buffer->size + len + 1 > buffer->cap) {
+    size_t cap = buffer->cap == 0 ? 4096 : buffer->cap;
+    while (buffer->size + len + 1 > cap) {
+      cap *= 2;
+    }
+    buffer->data = (char *)realloc(buffer->data, cap);
+    buffer->cap = cap;
+  }
+  memcpy(buffer->data + buffer->size, path, len);
+  buffer->data[buffer->size + len] = '\0';
+  buffer->size += len + 1;
+  buffer->count++;
+}
+
+/* patterns with a slash are matched against the path relative to the root,
+ * all others against the entry name */
+static bool ignored(fzf_walker_t *walker, const char *name,
+                    const char *path) {
+  if (name[0] == '.') {
+    if (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) {
+      return true;
+    }
+    if (!walker->hidden) {
+      return true;
+    }
+  }
+  for (size_t i = 0; i < walker->ignore_count; i++) {
+    const char *pattern = walker->ignore[i];
+    if (strchr(pattern, '/') != NULL) {
+      if (fnmatch(pattern, path, FNM_PATHNAME) == 0) {
+        return true;
+      }
+    } else if (fnmatch(pattern, name, 0) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool is_dir(fzf_walker_t *walker, struct dirent *entry,
+                   const char *path) {
+#ifdef DT_DIR
+  if (entry->d_type != DT_UNKNOWN) {
+    return entry->d_type == DT_DIR;
+  }
+#endif
+  struct stat st;
+  if (fstatat(walker->root_fd, path, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return false;
+  }
+  return S_ISDIR(st.st_mode);
+}
+
+/* reads one directory, files go into `found`, directories into `dirs` */
+static void walk_dir(fzf_walker_t *walker, const char *dir, dir_queue_t *dirs,
+                     path_buffer_t *found) {
+  int fd = openat(walker->root_fd, dir[0] ? dir : ".",
+                  O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+  DIR *handle = fdopendir(fd);
+  if (handle == NULL) {
+    close(fd);
+    return;
+  }
+
+  size_t dir_len = strlen(dir);
+  char *path = NULL;
+  size_t path_cap = 0;
+  struct dirent *entry;
+  while ((entry = readdir(handle)) != NULL) {
+    size_t name_len = strlen(entry->d_name);
+    size_t len = dir_len + (dir_len > 0) + name_len;
+    if (len + 1 > path_cap) {
+      path_cap = len + 1;
+      path = (char *)realloc(path, path_cap);
+    }
+    if (dir_len > 0) {
+      memcpy(path, dir, dir_len);
+      path[dir_len] = '/';
+    }
+    memcpy(path + len - name_len, entry->d_name, name_len + 1);
+    if (ignored(walker, entry->d_name, path)) {
+      continue;
+    }
+
+    if (is_dir(walker, entry, path)) {
+      queue_push(dirs, strdup(path));
+    } else {
+      buffer_append(found, path, len);
+    }
+  }
+  SFREE(path);
+  closedir(handle);
+}
+
+static void *walk_worker(void *data) {
+  fzf_walker_t *walker = (fzf_walker_t *)data;
+  dir_queue_t dirs = {0};
+  path_buffer_t found = {0};
+
+  pthread_mutex_lock(&walker->mutex);
+  for (;;) {
+    while (walker->queue.size == 0 && walker->pending > 0 &&
+           !walker->cancelled) {
+      pthread_cond_wait(&walker->cond, &walker->mutex);
+    }
+    if (walker->queue.size == 0 || walker->cancelled) {
+      break;
+    }
+    char *dir = walker->queue.data[--walker->queue.size];
+    pthread_mutex_unlock(&walker->mutex);
+
+    walk_dir(walker, dir, &dirs, &found);
+    free(dir);
+
+    pthread_mutex_lock(&walker->mutex);
+    for (size_t i = 0; i < dirs.size; i++) {
+      queue_push(&walker->queue, dirs.data[i]);
+    }
+    walker->pending += dirs.size;
+    walker->pending--;
+    dirs.size = 0;
+    if (found.count > 0) {
+      path_buffer_t *out = &walker->found;
+      if (out->count == 0) {
+        // hand over our buffer instead of copying it
+        path_buffer_t tmp = *out;
+        *out = found;
+        found = tmp;
+        found.size = 0;
+        found.count = 0;
+      } else {
+        for (size_t off = 0; off < found.size;) {
+          size_t len = strlen(found.data + off);
+          buffer_append(out, found.data + off, len);
+          off += len + 1;
+        }
+        found.size = 0;
+        found.count = 0;
+      }
+    }
+    pthread_cond_broadcast(&walker->cond);
+  }
+  pthread_mutex_unlock(&walker->mutex);
+
+  SFREE(dirs.data);
+  SFREE(found.data);
+  return NULL;
+}
+
+fzf_walker_t *fzf_walk_start(const char *root, fzf_walk_opts_t opts) {
+  int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root_fd < 0) {
+    return NULL;
+  }
+
+  fzf_walker_t *walker = (fzf_walker_t *)malloc(sizeof(fzf_walker_t));
+  memset(walker, 0, sizeof(*walker));
+  walker->root_fd = root_fd;
+  walker->hidden = opts.hidden;
+  walker->ignore_count = opts.ignore_count;
+  if (opts.ignore_count > 0) {
+    walker->ignore = (char **)malloc(opts.ignore_count * sizeof(char *));
+    for (size_t i = 0; i < opts.ignore_count; i++) {
+      walker->ignore[i] = strdup(opts.ignore[i]);
+    }
+  }
+  pthread_mutex_init(&walker->mutex, NULL);
+  pthread_cond_init(&walker->cond, NULL);
+
+  queue_push(&walker->queue, strdup(""));
+  walker->pending = 1;
+
+  walker->thread_count = opts.threads;
+  if (walker->thread_count == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    walker->thread_count = cpus > 0 ? (size_t)cpus : 1;
+    if (walker->thread_count > WALK_MAX_THREADS) {
+      walker->thread_count = WALK_MAX_THREADS;
+    }
+  }
+  walker->threads =
+      (pthread_t *)malloc(walker->thread_count * sizeof(pthread_t));
+  for (size_t i = 0; i < walker->thread_count; i++) {
+    pthread_create(&walker->threads[i], NULL, walk_worker, walker);
+  }
+  return walker;
+}
+
+size_t fzf_walk_drain(fzf_walker_t *walker, fzf_corpus_t *corpus) {
+  pthread_mutex_lock(&walker->mutex);
+  path_buffer_t found = walker->found;
+  memset(&walker->found, 0, sizeof(walker->found));
+  pthread_mutex_unlock(&walker->mutex);
+
+  for (size_t off = 0; off < found.size;) {
+    size_t len = strlen(found.data + off);
+    fzf_corpus_append(corpus, found.data + off, len);
+    off += len + 1;
+  }
+  SFREE(found.data);
+  return found.count;
+}
+
+bool fzf_walk_done(fzf_walker_t *walker) {
+  pthread_mutex_lock(&walker->mutex);
+  bool done = walker->pending == 0 || walker->cancelled;
+  pthread_mutex_unlock(&walker->mutex);
+  return done;
+}
+
+void fzf_walk_cancel(fzf_walker_t *walker) {
+  pthread_mutex_lock(&walker->mutex);
+  walker->cancelled = true;
+  pthread_cond_broadcast(&walker->cond);
+  pthread_mutex_unlock(&walker->mutex);
+}
+
+void fzf_free_walker(fzf_walker_t *walker) {
+  if (walker) {
+    fzf_walk_cancel(walker);
+    for (size_t i = 0; i < walker->thread_count; i++) {
+      pthread_join(walker->threads[i], NULL);
+    }
+    free(walker->threads);
+    for (size_t i = 0; i < walker->queue.size; i++) {
+      free(walker->queue.data[i]);
+    }
+    SFREE(walker->queue.data);
+    SFREE(walker->found.data);
+    for (size_t i = 0; i < walker->ignore_count; i++) {
+      free(walker->ignore[i]);
+    }
+    SFREE(walker->ignore);
+    pthread_cond_destroy(&walker->cond);
+    pthread_mutex_destroy(&walker->mutex);
+    close(walker->root_fd);
+    free(walker);
+  }
+}
+#endif
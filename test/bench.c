@@ -0,0 +1,227 @@
+#include "fzf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Replays interactive typing sessions against synthetic path corpora and
+ * reports the latency of every keystroke. A keystroke is what telescope does
+ * on each prompt change: parse the prompt, score the whole corpus, select the
+ * top results and highlight them. */
+
+#define TOP_K 50
+#define BACKSPACE '\b'
+
+static const char *sessions[] = {
+    "fzfnative",
+    "srcfzfc\b\b\b.c",
+    "telescope ext\b\b\bfzf",
+    "lua | src",
+    "main !test",
+    "^src .c$ | .h$",
+    "buildcach\b\b\b\bconfig !'node",
+};
+
+static const char *dirs[] = {
+    "src",     "lua",    "test",      "build",   "docs",    "include",
+    "lib",     "cmd",    "internal",  "pkg",     "vendor",  "scripts",
+    "assets",  "config", "telescope", "plugins", "core",    "utils",
+    "modules", "api",    "server",    "client",  "node_modules",
+};
+
+static const char *names[] = {
+    "main",    "fzf",    "native",  "picker",  "sorter", "finder",
+    "helpers", "config", "init",    "util",    "parser", "matcher",
+    "cache",   "index",  "worker",  "pattern", "README", "CHANGELOG",
+    "Makefile", "test",  "bench",   "query",   "engine", "layout",
+};
+
+static const char *exts[] = {".c",  ".h",   ".lua", ".md", ".txt",
+                             ".go", ".rs",  ".py",  ".js", ".json"};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static char **make_corpus(size_t n) {
+  char **corpus = (char **)malloc(n * sizeof(char *));
+  char buf[512];
+  for (size_t i = 0; i < n; i++) {
+    size_t len = 0;
+    size_t depth = 1 + rng_next() % 6;
+    for (size_t d = 0; d < depth; d++) {
+      len += (size_t)snprintf(buf + len, sizeof(buf) - len, "%s/",
+                              dirs[rng_next() % ARRAY_SIZE(dirs)]);
+    }
+    snprintf(buf + len, sizeof(buf) - len, "%s_%u%s",
+             names[rng_next() % ARRAY_SIZE(names)],
+             (unsigned)(rng_next() % 1000),
+             exts[rng_next() % ARRAY_SIZE(exts)]);
+    corpus[i] = strdup(buf);
+  }
+  return corpus;
+}
+
+static void free_corpus(char **corpus, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    free(corpus[i]);
+  }
+  free(corpus);
+}
+
+typedef struct {
+  int32_t score;
+  size_t idx;
+} entry_t;
+
+/* min-heap on score, the root is the worst entry currently kept */
+static void sift_down(entry_t *heap, size_t size, size_t i) {
+  for (;;) {
+    size_t l = 2 * i + 1;
+    size_t r = l + 1;
+    size_t m = i;
+    if (l < size && heap[l].score < heap[m].score) {
+      m = l;
+    }
+    if (r < size && heap[r].score < heap[m].score) {
+      m = r;
+    }
+    if (m == i) {
+      return;
+    }
+    entry_t tmp = heap[i];
+    heap[i] = heap[m];
+    heap[m] = tmp;
+    i = m;
+  }
+}
+
+static void sift_up(entry_t *heap, size_t i) {
+  while (i > 0) {
+    size_t p = (i - 1) / 2;
+    if (heap[p].score <= heap[i].score) {
+      return;
+    }
+    entry_t tmp = heap[i];
+    heap[i] = heap[p];
+    heap[p] = tmp;
+    i = p;
+  }
+}
+
+static size_t keystroke(char **corpus, size_t n, const char *prompt,
+                        fzf_slab_t *slab) {
+  char *copy = strdup(prompt);
+  fzf_pattern_t *pattern = fzf_parse_pattern(CaseSmart, false, copy, true);
+
+  entry_t heap[TOP_K];
+  size_t heap_size = 0;
+  size_t matched = 0;
+  for (size_t i = 0; i < n; i++) {
+    int32_t score = fzf_get_score(corpus[i], pattern, slab);
+    if (score <= 0) {
+      continue;
+    }
+    matched++;
+    if (heap_size < TOP_K) {
+      heap[heap_size] = (entry_t){score, i};
+      sift_up(heap, heap_size++);
+    } else if (score > heap[0].score) {
+      heap[0] = (entry_t){score, i};
+      sift_down(heap, heap_size, 0);
+    }
+  }
+
+  for (size_t i = 0; i < heap_size; i++) {
+    fzf_free_positions(fzf_get_positions(corpus[heap[i].idx], pattern, slab));
+  }
+
+  fzf_free_pattern(pattern);
+  free(copy);
+  return matched;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_ms(uint64_t *sorted, size_t n, double p) {
+  size_t rank = (size_t)(p * (double)(n - 1) + 0.5);
+  return (double)sorted[rank] / 1e6;
+}
+
+static void run(size_t n) {
+  char **corpus = make_corpus(n);
+  fzf_slab_t *slab = fzf_make_default_slab();
+
+  size_t cap = 0;
+  for (size_t s = 0; s < ARRAY_SIZE(sessions); s++) {
+    cap += strlen(sessions[s]);
+  }
+  uint64_t *latencies = (uint64_t *)malloc(cap * sizeof(uint64_t));
+  size_t count = 0;
+  uint64_t total = 0;
+
+  char prompt[256];
+  for (size_t s = 0; s < ARRAY_SIZE(sessions); s++) {
+    size_t len = 0;
+    for (const char *key = sessions[s]; *key; key++) {
+      if (*key == BACKSPACE) {
+        if (len > 0) {
+          len--;
+        }
+      } else if (len + 1 < sizeof(prompt)) {
+        prompt[len++] = *key;
+      }
+      prompt[len] = '\0';
+
+      uint64_t start = now_ns();
+      keystroke(corpus, n, prompt, slab);
+      uint64_t elapsed = now_ns() - start;
+      latencies[count++] = elapsed;
+      total += elapsed;
+    }
+  }
+
+  qsort(latencies, count, sizeof(uint64_t), cmp_u64);
+  printf("%9zu items %4zu keystrokes  p50 %9.3f ms  p95 %9.3f ms  "
+         "p99 %9.3f ms  max %9.3f ms  mean %9.3f ms\n",
+         n, count, percentile_ms(latencies, count, 0.50),
+         percentile_ms(latencies, count, 0.95),
+         percentile_ms(latencies, count, 0.99),
+         (double)latencies[count - 1] / 1e6,
+         (double)total / (double)count / 1e6);
+
+  free(latencies);
+  fzf_free_slab(slab);
+  free_corpus(corpus, n);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) {
+      run((size_t)strtoull(argv[i], NULL, 10));
+    }
+    return 0;
+  }
+  run(10000);
+  run(100000);
+  run(1000000);
+  return 0;
+}
@@ -107,5 +107,303 @@ describe("fzf", function()
     eq(expected, fzf.get_pos("feature/1337-some-times-i-have-a-lot-of-hyphens", p, slab))
     fzf.free_pattern(p)
   end)
+
+  it("can get the score and pos in one pass", function()
+    local p = fzf.parse_pattern("fzf", 0)
+    local score, pos = fzf.get_score_and_pos("src/fzf", p, slab)
+    eq(fzf.get_score("src/fzf", p, slab), score)
+    eq({ 7, 6, 5 }, pos)
+    score, pos = fzf.get_score_and_pos("asdf", p, slab)
+    eq(0, score)
+    is_nil(pos)
+    fzf.free_pattern(p)
+  end)
+
+  it("can reuse positions from a match cache", function()
+    local cache = fzf.make_match_cache(1)
+    local p = fzf.parse_pattern("fzf", 0)
+    eq(fzf.get_score("src/fzf", p, slab), fzf.cached_score(cache, "src/fzf", p, slab))
+    eq(0, fzf.cached_score(cache, "asdf", p, slab))
+    eq({ 7, 6, 5 }, fzf.cached_pos(cache, "src/fzf", p, slab))
+    eq({ 3, 2, 1 }, fzf.cached_pos(cache, "lua/fzf_lib.lua", p, slab))
+    is_nil(fzf.cached_pos(cache, "asdf", p, slab))
+    fzf.free_pattern(p)
+    fzf.free_match_cache(cache)
+  end)
+
+  it("can normalize latin letters", function()
+    local p = fzf.parse_pattern("cafe", 0, true, true)
+    eq(fzf.get_score("cafe", p, slab), fzf.get_score("café", p, slab))
+    eq({ 4, 3, 2, 1 }, fzf.get_pos("café", p, slab))
+    fzf.free_pattern(p)
+    p = fzf.parse_pattern("cafe", 0)
+    eq(0, fzf.get_score("café", p, slab))
+    fzf.free_pattern(p)
+
+    -- lines normalized once, positions refer to the original line
+    eq("cafe", fzf.normalize_text("café"))
+    eq("tea", fzf.normalize_text("tea"))
+    p = fzf.parse_pattern(fzf.normalize_text("café"), 0)
+    eq({ 7, 6, 5, 4 }, fzf.get_pos(fzf.normalize_text("le café"), p, slab, "le café"))
+    fzf.free_pattern(p)
+
+    local stream = fzf.make_stream(0, true, 10, true)
+    fzf.stream_set_prompt(stream, "cafe", slab)
+    fzf.stream_push(stream, { "le café", "cafe", "tea" }, slab)
+    eq(2, fzf.stream_matched(stream))
+    fzf.free_stream(stream)
+  end)
+
+  it("can collect stats on a slab", function()
+    local s = fzf.allocate_slab()
+    is_nil(fzf.get_stats(s))
+    fzf.enable_stats(s)
+    local p = fzf.parse_pattern("fzf", 0)
+    fzf.get_score("src/fzf", p, s)
+    fzf.get_score("asdf", p, s)
+    -- nil if the library was built without stats
+    local stats = fzf.get_stats(s)
+    if stats then
+      eq(2, stats.fuzzy_v2_calls)
+      eq(1, stats.prefilter_rejects)
+      eq(7 + 4, stats.bytes_scanned)
+      fzf.reset_stats(s)
+      eq(0, fzf.get_stats(s).fuzzy_v2_calls)
+    end
+    fzf.free_pattern(p)
+    fzf.free_slab(s)
+  end)
+
+  it("can reuse pooled slabs", function()
+    local s = fzf.acquire_slab()
+    fzf.enable_stats(s)
+    fzf.release_slab(s)
+    local again = fzf.acquire_slab()
+    eq(true, again == s)
+    is_nil(fzf.get_stats(again))
+    fzf.release_slab(again)
+  end)
+
+  it("can grow auto sized slabs", function()
+    local s = fzf.allocate_slab { size_16 = 16, size_32 = 16, auto_size = true }
+    fzf.enable_stats(s)
+    local p = fzf.parse_pattern("fzf", 0)
+    eq(fzf.get_score("fzf/src/fzf", p, slab), fzf.get_score("fzf/src/fzf", p, s))
+    local stats = fzf.get_stats(s)
+    if stats then
+      eq(0, stats.v1_fallbacks)
+      eq(1, stats.slab_grows)
+    end
+    fzf.free_pattern(p)
+    fzf.free_slab(s)
+  end)
+
+  it("can record latency histograms", function()
+    fzf.reset_timing()
+    fzf.enable_timing()
+    local p = fzf.parse_pattern("fzf", 0)
+    fzf.get_score("src/fzf", p, slab)
+    fzf.get_pos("src/fzf", p, slab)
+    fzf.disable_timing()
+    fzf.get_score("src/fzf", p, slab)
+    eq(1, fzf.get_timing("parse_pattern").count)
+    eq(1, fzf.get_timing("get_score").count)
+    eq(1, fzf.get_timing("get_positions").count)
+    assert.is_true(fzf.get_timing("get_score").p99_ns <= fzf.get_timing("get_score").max_ns)
+    fzf.reset_timing()
+    fzf.free_pattern(p)
+  end)
+
+  it("can stream items into a maintained top k", function()
+    local stream = fzf.make_stream(0, true, 2)
+    fzf.stream_set_prompt(stream, "f", slab)
+    fzf.stream_push(stream, { "src/fzf.c", "README.md", "lua/fzf_lib.lua" }, slab)
+    eq(2, fzf.stream_matched(stream))
+    fzf.stream_push(stream, { "test/test.c", "src/fzf.h", "fzf" }, slab)
+    eq(5, fzf.stream_matched(stream))
+    eq(6, fzf.stream_top(stream)[1].idx)
+
+    fzf.stream_set_prompt(stream, "fzf", slab)
+    eq(4, fzf.stream_matched(stream))
+    local p = fzf.parse_pattern("fzf", 0)
+    local top = fzf.stream_top(stream)
+    eq({ idx = 6, score = fzf.get_score("fzf", p, slab) }, top[1])
+    eq(2, #top)
+    local all = fzf.stream_all(stream)
+    eq(4, #all)
+    eq(top, { all[1], all[2] })
+
+    local res = fzf.stream_result(stream, { all = true, ranges = true }, slab)
+    eq(4, tonumber(res.size))
+    eq(5, res.idx[0])
+    eq(top[1].score, res.score[0])
+    eq({ 0, 3 }, { res.begin[0], res["end"][0] })
+    fzf.free_pattern(p)
+    fzf.free_stream(stream)
+  end)
+
+  it("can keep matrix rows while typing into a stream", function()
+    local stream = fzf.make_stream(0, true, 2)
+    fzf.stream_row_cache(stream)
+    fzf.enable_stats(slab)
+    fzf.stream_push(stream, { "src/fzf.c", "README.md", "src/fzf.h", "fzf" }, slab)
+    fzf.stream_set_prompt(stream, "f", slab)
+    fzf.stream_set_prompt(stream, "fz", slab)
+    fzf.stream_set_prompt(stream, "fzf", slab)
+    eq(3, fzf.stream_matched(stream))
+    eq({ 4, 1 }, { fzf.stream_top(stream)[1].idx, fzf.stream_top(stream)[2].idx })
+    local stats = fzf.get_stats(slab)
+    if stats then
+      assert.is_true(stats.cached_rows > 0)
+    end
+    fzf.disable_stats(slab)
+    fzf.free_stream(stream)
+  end)
+
+  it("can blend weights into a stream", function()
+    local stream = fzf.make_stream(0, true, 2)
+    fzf.stream_set_prompt(stream, "fzf", slab)
+    fzf.stream_push(stream, { "src/fzf.c", "README.md", "src/fzf.h", "fzf" }, slab)
+    eq({ 4, 1 }, { fzf.stream_top(stream)[1].idx, fzf.stream_top(stream)[2].idx })
+    fzf.stream_set_weights(stream, { 0, 100, 50 }, { factor = 2 }, slab)
+    eq(3, fzf.stream_matched(stream))
+    eq({ 3, 4 }, { fzf.stream_top(stream)[1].idx, fzf.stream_top(stream)[2].idx })
+    fzf.stream_set_weights(stream, nil, nil, slab)
+    eq(4, fzf.stream_top(stream)[1].idx)
+    fzf.free_stream(stream)
+  end)
+
+  it("can score a corpus in the background", function()
+    local corpus = fzf.make_corpus()
+    fzf.corpus_append(corpus, { "src/fzf.c", "README.md", "lua/fzf_lib.lua", "fzf" })
+    local job = fzf.submit_job(corpus, "fzf", { k = 2 })
+    local top, matched = fzf.job_collect(job)
+    eq("done", fzf.job_poll(job))
+    eq(3, matched)
+    eq({ 4, 1 }, { top[1].idx, top[2].idx })
+    local res = fzf.job_result(job)
+    fzf.free_job(job)
+    eq({ 3, 0 }, { res.idx[0], res.idx[1] })
+
+    job = fzf.submit_job(corpus, "fzf", { k = 2, owner = 1 })
+    local newer = fzf.submit_job(corpus, "fzf", { k = 2, owner = 1, priority = 1 })
+    fzf.job_collect(newer)
+    eq("done", fzf.job_poll(newer))
+    fzf.free_job(newer)
+    fzf.job_cancel(job)
+    eq("cancelled", fzf.job_poll(job))
+    is_nil(fzf.job_collect(job))
+    fzf.free_job(job)
+    fzf.free_corpus(corpus)
+  end)
+
+  it("can match file names first", function()
+    local stream = fzf.make_stream(0, true, 10)
+    fzf.basename_first(stream)
+    fzf.stream_set_prompt(stream, "fzf", slab)
+    fzf.stream_push(stream, { "src/fzf/main.c", "lua/fzf_lib.lua" }, slab)
+    local p = fzf.parse_pattern("fzf", 0)
+    local scores = {}
+    for _, match in ipairs(fzf.stream_top(stream)) do
+      scores[match.idx] = match.score
+    end
+    eq({ fzf.get_score("src/fzf/main.c", p, slab), fzf.get_score("fzf_lib.lua", p, slab) }, scores)
+    fzf.free_pattern(p)
+    fzf.free_stream(stream)
+  end)
+
+  it("can restrict matching to fields", function()
+    local p = fzf.parse_pattern("fzf", 0)
+    local whole = fzf.get_score("fzf_get_score", p, slab)
+    eq(true, fzf.set_nth(p, ":", "4.."))
+    eq(whole, fzf.get_score("src/fzf.c:10:5:fzf_get_score", p, slab))
+    eq(0, fzf.get_score("src/fzf.c:10:5:main", p, slab))
+    eq(false, fzf.set_nth(p, ":", "0"))
+    eq(true, fzf.set_nth(p, nil, "-1"))
+    eq(0, fzf.get_score("fzf.c main", p, slab))
+    fzf.free_pattern(p)
+
+    local stream = fzf.make_stream(0, true, 10)
+    fzf.stream_push(stream, { "src/fzf.c:1:main", "README.md:3:fzf" }, slab)
+    fzf.stream_set_prompt(stream, "fzf", slab)
+    eq(true, fzf.set_nth(stream, ":", "3", slab))
+    eq(1, fzf.stream_matched(stream))
+    eq(2, fzf.stream_top(stream)[1].idx)
+    fzf.free_stream(stream)
+  end)
+
+  it("can deduplicate identical items", function()
+    local corpus = fzf.make_corpus { dedup = true }
+    fzf.corpus_append(corpus, { "src/fzf.c", "README.md", "src/fzf.c", "fzf", "src/fzf.c" })
+    eq(3, fzf.corpus_count(corpus))
+    eq(5, fzf.corpus_inputs(corpus))
+    eq({ 1, 3, 5 }, fzf.corpus_fanout(corpus, 1))
+    local job = fzf.submit_job(corpus, "fzf", { k = 10 })
+    local top, matched = fzf.job_collect(job)
+    eq(2, matched)
+    eq({ 4 }, fzf.corpus_fanout(corpus, top[1].idx))
+    fzf.free_job(job)
+    fzf.free_corpus(corpus)
+  end)
+
+  it("can load a corpus from a file", function()
+    local path = vim.fn.tempname()
+    vim.fn.writefile({ "src/fzf.c", "README.md", "lua/fzf_lib.lua" }, path)
+    local corpus = fzf.load_corpus(path)
+    eq(3, fzf.corpus_count(corpus))
+    eq("README.md", fzf.corpus_get(corpus, 2))
+    local job = fzf.submit_job(corpus, "fzf", { k = 1 })
+    local top = fzf.job_collect(job)
+    eq("src/fzf.c", fzf.corpus_get(corpus, top[1].idx))
+    fzf.free_job(job)
+    fzf.free_corpus(corpus)
+    vim.fn.delete(path)
+    is_nil(fzf.load_corpus(path))
+  end)
+
+  it("can persist a corpus index", function()
+    local path = vim.fn.tempname()
+    vim.fn.writefile({ "src/fzf.c", "README.md", "lua/fzf_lib.lua" }, path)
+    local corpus = fzf.load_corpus(path)
+    eq(true, fzf.save_index(corpus, path .. ".idx", path))
+    fzf.free_corpus(corpus)
+
+    corpus = fzf.load_index(path .. ".idx", path)
+    eq(3, fzf.corpus_count(corpus))
+    eq("lua/fzf_lib.lua", fzf.corpus_get(corpus, 3))
+    fzf.free_corpus(corpus)
+
+    vim.fn.writefile({ "src/fzf.h" }, path, "a")
+    is_nil(fzf.load_index(path .. ".idx", path))
+    vim.fn.delete(path)
+    vim.fn.delete(path .. ".idx")
+  end)
+
+  it("can walk a directory into a stream", function()
+    local root = vim.fn.tempname()
+    vim.fn.mkdir(root .. "/src", "p")
+    vim.fn.mkdir(root .. "/.git", "p")
+    vim.fn.mkdir(root .. "/build", "p")
+    vim.fn.writefile({}, root .. "/src/fzf.c")
+    vim.fn.writefile({}, root .. "/README.md")
+    vim.fn.writefile({}, root .. "/.git/HEAD")
+    vim.fn.writefile({}, root .. "/build/libfzf.so")
+
+    local stream = fzf.make_stream(0, true, 10)
+    fzf.stream_set_prompt(stream, "fzf", slab)
+    local walker = fzf.walk_start(root, { ignore = { "build" } })
+    local found = 0
+    repeat
+      local done = fzf.walk_done(walker)
+      found = found + fzf.walk_drain(walker, stream, slab)
+    until done
+    fzf.free_walker(walker)
+    eq(2, found)
+    eq(1, fzf.stream_matched(stream))
+    fzf.free_stream(stream)
+
+    is_nil(fzf.walk_start(root .. "/missing"))
+    vim.fn.delete(root, "rf")
+  end)
   fzf.free_slab(slab)
 end)
@@ -1,8 +1,13 @@
 #include "fzf.h"
 
 #include <examiner.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 typedef enum {
   ScoreMatch = 16,
@@ -566,6 +571,39 @@ TEST(PatternParsing, smartCase) {
   fzf_free_pattern(pat);
 }
 
+TEST(PatternParsing, specializedMatchers) {
+  const char *items[] = {"lua/fzf_lib.lua", "Lua/telescope.lua", " lua ",
+                         "src/fzf.c", NULL};
+  const char *prompts[] = {"lua", "Lua", "'ua", "^lua", "lua$", "^lua$", NULL};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  for (size_t p = 0; prompts[p]; p++) {
+    char prompt[16];
+    strcpy(prompt, prompts[p]);
+    fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, prompt, true);
+    fzf_term_t *term = &pat->ptr[0]->ptr[0];
+    ASSERT_TRUE(term->match != NULL);
+    for (size_t i = 0; items[i]; i++) {
+      fzf_string_t input = {.data = items[i], .size = strlen(items[i])};
+      fzf_position_t *a = fzf_pos_array(0);
+      fzf_position_t *b = fzf_pos_array(0);
+      fzf_result_t generic = term->fn(term->case_sensitive, false, &input,
+                                      term->text, a, slab);
+      fzf_result_t specialized = term->match(&input, term->text, b, slab);
+      ASSERT_EQ(generic.start, specialized.start);
+      ASSERT_EQ(generic.end, specialized.end);
+      ASSERT_EQ(generic.score, specialized.score);
+      ASSERT_EQ(a->size, b->size);
+      for (size_t j = 0; j < a->size; j++) {
+        ASSERT_EQ(a->data[j], b->data[j]);
+      }
+      fzf_free_positions(a);
+      fzf_free_positions(b);
+    }
+    fzf_free_pattern(pat);
+  }
+  fzf_free_slab(slab);
+}
+
 TEST(PatternParsing, simpleOr) {
   fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "'src | ^Lua", true);
   ASSERT_EQ(1, pat->size);
@@ -765,6 +803,1298 @@ TEST(PosIntegration, complexTerm) {
   pos_wrapper(".lua$ 'previewer !'term", input, expected);
 }
 
+TEST(PosIntegration, scoreAndPositions) {
+  char *input[] = {"src/fzf.c", "lua/fzf_lib.lua", "test/test.c", "README.md",
+                   NULL};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf | test !lua",
+                                         true);
+  for (size_t i = 0; input[i] != NULL; ++i) {
+    int32_t score = -1;
+    fzf_position_t *pos = fzf_get_match(input[i], pat, slab, &score);
+    fzf_position_t *expected = fzf_get_positions(input[i], pat, slab);
+    ASSERT_EQ(fzf_get_score(input[i], pat, slab), score);
+    if (expected == NULL) {
+      ASSERT_EQ((void *)NULL, (void *)pos);
+      continue;
+    }
+    ASSERT_EQ(expected->size, pos->size);
+    ASSERT_EQ_MEM(expected->data, pos->data, pos->size * sizeof(uint32_t));
+    fzf_free_positions(expected);
+    fzf_free_positions(pos);
+  }
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+}
+
+TEST(PosIntegration, matchCache) {
+  char *input[] = {"lua/fuzzy_finder.lua", "src/fzf.c", "f_z_f", "README.md",
+                   NULL};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_slab_t *reference = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  fzf_match_cache_t *cache = fzf_make_match_cache(1);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  for (size_t i = 0; input[i] != NULL; ++i) {
+    ASSERT_EQ(fzf_get_score(input[i], pat, reference),
+              fzf_cached_score(cache, input[i], pat, slab));
+  }
+
+  // the best item is highlighted from the cache
+  fzf_reset_stats(slab);
+  fzf_position_t *pos = fzf_cached_positions(cache, "src/fzf.c", pat, slab);
+  fzf_position_t *expected = fzf_get_positions("src/fzf.c", pat, reference);
+  if (fzf_get_stats(slab)) {
+    ASSERT_EQ(0, fzf_get_stats(slab)->fuzzy_v2_calls);
+  }
+  ASSERT_EQ(expected->size, pos->size);
+  ASSERT_EQ_MEM(expected->data, pos->data, pos->size * sizeof(uint32_t));
+  fzf_free_positions(expected);
+  fzf_free_positions(pos);
+  fzf_free_positions(
+      fzf_cached_positions(cache, "lua/fuzzy_finder.lua", pat, slab));
+  if (fzf_get_stats(slab)) {
+    ASSERT_EQ(1, fzf_get_stats(slab)->fuzzy_v2_calls);
+  }
+
+  // another pattern misses
+  fzf_pattern_t *other = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  fzf_free_positions(fzf_cached_positions(cache, "src/fzf.c", other, slab));
+  if (fzf_get_stats(slab)) {
+    ASSERT_EQ(2, fzf_get_stats(slab)->fuzzy_v2_calls);
+  }
+
+  fzf_free_pattern(other);
+  fzf_free_pattern(pat);
+  fzf_free_match_cache(cache);
+  fzf_free_slab(reference);
+  fzf_free_slab(slab);
+}
+
+TEST(PosIntegration, normalize) {
+  // "crème brûlée"
+  const char *text = "cr\xc3\xa8me br\xc3\xbbl\xc3\xa9"
+                     "e";
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "brulee", true);
+  ASSERT_EQ(0, fzf_get_score(text, pat, slab));
+  fzf_free_pattern(pat);
+
+  pat = fzf_parse_pattern(CaseSmart, true, "brulee", true);
+  ASSERT_TRUE(pat->normalize);
+  ASSERT_EQ(fzf_get_score("creme brulee", pat, slab),
+            fzf_get_score(text, pat, slab));
+  fzf_position_t *pos = fzf_get_positions(text, pat, slab);
+  ASSERT_EQ(6, pos->size);
+  uint32_t expected[] = {14, 12, 11, 9, 8, 7};
+  for (size_t i = 0; i < 6; i++) {
+    ASSERT_EQ(expected[i], pos->data[i]);
+  }
+  fzf_free_positions(pos);
+  fzf_free_pattern(pat);
+
+  // the pattern is normalized as well
+  char prompt[] = "br\xc3\xbbl\xc3\xa9"
+                  "e";
+  pat = fzf_parse_pattern(CaseSmart, true, prompt, true);
+  ASSERT_EQ("brulee", ((fzf_string_t *)pat->ptr[0]->ptr[0].text)->data);
+  ASSERT_TRUE(fzf_get_score("brulee", pat, slab) > 0);
+  ASSERT_TRUE(fzf_get_score("BR\xc3\x9bL\xc3\x89"
+                            "E",
+                            pat, slab) > 0);
+  fzf_free_pattern(pat);
+
+  // items normalized once by the caller, positions are mapped back
+  char out[16];
+  size_t len = strlen(text);
+  out[fzf_normalize_text(text, len, out)] = '\0';
+  ASSERT_EQ("creme brulee", out);
+  ASSERT_EQ(3, fzf_normalize_text("tea", 3, out));
+  pat = fzf_parse_pattern(CaseSmart, false, "brulee", true);
+  pos = fzf_get_positions("creme brulee", pat, slab);
+  fzf_denormalize_positions(text, len, pos);
+  ASSERT_EQ(6, pos->size);
+  for (size_t i = 0; i < 6; i++) {
+    ASSERT_EQ(expected[i], pos->data[i]);
+  }
+  fzf_free_positions(pos);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+}
+
+TEST(PatternParsing, nth) {
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, ':', "1,-2..,..3,2..4"));
+  ASSERT_EQ(4, pat->nth_size);
+  ASSERT_EQ(1, pat->nth[0].begin);
+  ASSERT_EQ(1, pat->nth[0].end);
+  ASSERT_EQ(-2, pat->nth[1].begin);
+  ASSERT_EQ(0, pat->nth[1].end);
+  ASSERT_EQ(0, pat->nth[2].begin);
+  ASSERT_EQ(3, pat->nth[2].end);
+  ASSERT_EQ(2, pat->nth[3].begin);
+  ASSERT_EQ(4, pat->nth[3].end);
+
+  ASSERT_FALSE(fzf_pattern_set_nth(pat, ':', "0"));
+  ASSERT_EQ(0, pat->nth_size);
+  ASSERT_FALSE(fzf_pattern_set_nth(pat, ':', "1..2x"));
+  ASSERT_FALSE(fzf_pattern_set_nth(pat, ':', "1,,2"));
+  ASSERT_FALSE(fzf_pattern_set_nth(pat, ':', "1,2,3,4,5,6,7,8,9"));
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, ':', ".."));
+  ASSERT_EQ(1, pat->nth_size);
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, ':', NULL));
+  ASSERT_EQ(0, pat->nth_size);
+  fzf_free_pattern(pat);
+}
+
+TEST(ScoreIntegration, nth) {
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  int32_t whole = fzf_get_score("fzf_get_score", pat, slab);
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, ':', "4.."));
+  ASSERT_EQ(whole, fzf_get_score("src/fzf.c:10:5:fzf_get_score", pat, slab));
+  ASSERT_EQ(0, fzf_get_score("src/fzf.c:10:5:main", pat, slab));
+  ASSERT_EQ(0, fzf_get_score("src/fzf.c", pat, slab));
+
+  fzf_position_t *pos =
+      fzf_get_positions("src/fzf.c:10:5:fzf_get_score", pat, slab);
+  ASSERT_EQ(3, pos->size);
+  ASSERT_EQ(17, pos->data[0]);
+  ASSERT_EQ(15, pos->data[2]);
+  fzf_free_positions(pos);
+
+  // without a delimiter fields are separated by whitespace
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, 0, "2"));
+  ASSERT_TRUE(fzf_get_score("  main   fzf.c  12", pat, slab) > 0);
+  ASSERT_EQ(0, fzf_get_score("  fzf.c   main  12", pat, slab));
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, 0, "-1,1"));
+  ASSERT_TRUE(fzf_get_score("fzf.c main 12", pat, slab) > 0);
+  ASSERT_EQ(0, fzf_get_score("main fzf.c 12", pat, slab));
+  fzf_free_pattern(pat);
+
+  // inverse terms only look at the selected fields as well
+  pat = fzf_parse_pattern(CaseSmart, false, "!fzf", true);
+  ASSERT_TRUE(fzf_pattern_set_nth(pat, ':', "2"));
+  ASSERT_EQ(1, fzf_get_score("fzf.c:main", pat, slab));
+  ASSERT_EQ(0, fzf_get_score("main.c:fzf", pat, slab));
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+}
+
+TEST(ScoreIntegration, longLine) {
+  // buffers only cover the window that can contain a match
+  size_t pad = 10 * 1024;
+  char *line = (char *)malloc(2 * pad + 16);
+  memset(line, 'x', pad);
+  strcpy(line + pad, "/src/fzf.c/");
+  memset(line + pad + 11, 'x', pad);
+  line[2 * pad + 11] = '\0';
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  ASSERT_EQ(fzf_get_score("src/fzf.c", pat, slab),
+            fzf_get_score(line, pat, slab));
+  fzf_position_t *pos = fzf_get_positions(line, pat, slab);
+  ASSERT_EQ(3, pos->size);
+  ASSERT_EQ(pad + 7, pos->data[0]);
+  ASSERT_EQ(pad + 5, pos->data[2]);
+  fzf_free_positions(pos);
+
+  const fzf_stats_t *stats = fzf_get_stats(slab);
+  if (stats) {
+    ASSERT_EQ(0, stats->v1_fallbacks);
+    ASSERT_EQ(0, stats->heap_allocs16);
+    ASSERT_EQ(0, stats->heap_allocs32);
+  }
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  free(line);
+}
+
+TEST(Stats, disabledByDefault) {
+  fzf_slab_t *slab = fzf_make_default_slab();
+  ASSERT_EQ((void *)NULL, (void *)fzf_get_stats(slab));
+  fzf_free_slab(slab);
+}
+
+static void *pool_thread(void *data) {
+  fzf_slab_t **slabs = (fzf_slab_t **)data;
+  slabs[0] = fzf_acquire_slab();
+  fzf_release_slab(slabs[0]);
+  return NULL;
+}
+
+TEST(Slab, pool) {
+  fzf_slab_t *a = fzf_acquire_slab();
+  fzf_enable_stats(a);
+  fzf_release_slab(a);
+  ASSERT_TRUE(fzf_acquire_slab() == a);
+  ASSERT_EQ((void *)NULL, (void *)fzf_get_stats(a));
+
+  fzf_slab_t *b = fzf_acquire_slab();
+  ASSERT_TRUE(b != a);
+  fzf_release_slab(a);
+  fzf_release_slab(b);
+
+  // other threads get the shared slabs and hand theirs back when they exit
+  fzf_slab_t *seen[1];
+  pthread_t thread;
+  pthread_create(&thread, NULL, pool_thread, seen);
+  pthread_join(thread, NULL);
+  ASSERT_TRUE(seen[0] == b);
+  ASSERT_TRUE(fzf_acquire_slab() == a);
+  ASSERT_TRUE(fzf_acquire_slab() == b);
+  fzf_release_slab(a);
+  fzf_release_slab(b);
+  fzf_clear_slab_pool();
+}
+
+TEST(Slab, autoSize) {
+  fzf_slab_t *slab = fzf_make_slab((fzf_slab_config_t){16, 16, true});
+  ASSERT_EQ(0, (uintptr_t)slab->I16.data % 64);
+  ASSERT_EQ(0, (uintptr_t)slab->I32.data % 64);
+  fzf_enable_stats(slab);
+  fzf_slab_t *reference = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  ASSERT_EQ(fzf_get_score("fzf/src/fzf", pat, reference),
+            fzf_get_score("fzf/src/fzf", pat, slab));
+  ASSERT_EQ(fzf_get_score("src/fzf.c", pat, reference),
+            fzf_get_score("src/fzf.c", pat, slab));
+
+  const fzf_stats_t *stats = fzf_get_stats(slab);
+  if (stats) {
+    ASSERT_EQ(0, stats->v1_fallbacks);
+    ASSERT_EQ(0, stats->heap_allocs16);
+    ASSERT_EQ(0, stats->heap_allocs32);
+    ASSERT_EQ(1, stats->slab_grows);
+  }
+  ASSERT_TRUE(slab->I16.cap > 11 * 9);
+  ASSERT_EQ(0, (uintptr_t)slab->I16.data % 64);
+
+  // the pool hands out slabs of its current config
+  fzf_set_slab_pool_config((fzf_slab_config_t){16, 16, true});
+  fzf_slab_t *pooled = fzf_acquire_slab();
+  ASSERT_TRUE(pooled->config.auto_size);
+  ASSERT_EQ(16, pooled->I16.cap);
+  fzf_release_slab(pooled);
+  fzf_set_slab_pool_config((fzf_slab_config_t){100 * 1024, 2048});
+  pooled = fzf_acquire_slab();
+  ASSERT_FALSE(pooled->config.auto_size);
+  fzf_release_slab(pooled);
+  fzf_clear_slab_pool();
+
+  fzf_slab_t *huge =
+      fzf_make_slab((fzf_slab_config_t){2 * 1024 * 1024, 16, false, true});
+  ASSERT_EQ(0, (uintptr_t)huge->I16.data % 64);
+  ASSERT_EQ(fzf_get_score("src/fzf.c", pat, reference),
+            fzf_get_score("src/fzf.c", pat, huge));
+  fzf_free_slab(huge);
+
+  fzf_free_pattern(pat);
+  fzf_free_slab(reference);
+  fzf_free_slab(slab);
+}
+
+TEST(Stats, counters) {
+  fzf_slab_t *slab = fzf_make_slab((fzf_slab_config_t){16, 16});
+  fzf_enable_stats(slab);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf | ^src", true);
+  fzf_get_score("fzf/src/fzf", pat, slab);
+  fzf_get_score("asdf", pat, slab);
+
+  // NULL if the library is built with FZF_NO_STATS
+  const fzf_stats_t *stats = fzf_get_stats(slab);
+  if (stats) {
+    ASSERT_EQ(2, stats->fuzzy_v2_calls);
+    ASSERT_EQ(1, stats->fuzzy_v1_calls);
+    ASSERT_EQ(1, stats->v1_fallbacks);
+    ASSERT_EQ(1, stats->prefix_calls);
+    ASSERT_EQ(1, stats->prefilter_rejects);
+    ASSERT_EQ(11 + 4 + 4, stats->bytes_scanned);
+    ASSERT_EQ(0, stats->heap_allocs16);
+
+    fzf_reset_stats(slab);
+    ASSERT_EQ(0, stats->fuzzy_v2_calls);
+  }
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+}
+
+typedef struct {
+  size_t enter;
+  size_t exit;
+} trace_counter_t;
+
+static void count_trace(void *data, fzf_probe_types probe, bool enter,
+                        const char *text, uint64_t elapsed_ns) {
+  trace_counter_t *counter = (trace_counter_t *)data;
+  if (probe != ProbeGetScore) {
+    return;
+  }
+  if (enter) {
+    counter->enter++;
+  } else {
+    counter->exit++;
+  }
+}
+
+TEST(Timing, histograms) {
+  fzf_reset_timing();
+  fzf_enable_timing();
+  fzf_slab_t *slab = fzf_make_default_slab();
+  char pattern[] = "fzf";
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, pattern, true);
+  fzf_get_score("src/fzf", pat, slab);
+  fzf_get_score("asdf", pat, slab);
+  fzf_free_positions(fzf_get_positions("src/fzf", pat, slab));
+  fzf_disable_timing();
+  fzf_get_score("src/fzf", pat, slab);
+
+  fzf_histogram_t hist;
+  fzf_get_timing(ProbeParsePattern, &hist);
+  ASSERT_EQ(1, hist.count);
+  fzf_get_timing(ProbeGetScore, &hist);
+  ASSERT_EQ(2, hist.count);
+  uint64_t bucket_total = 0;
+  for (size_t i = 0; i < FZF_HIST_BUCKETS; i++) {
+    bucket_total += hist.buckets[i];
+  }
+  ASSERT_EQ(2, bucket_total);
+  ASSERT_TRUE(fzf_histogram_percentile(&hist, 0.99) <= hist.max_ns);
+  fzf_get_timing(ProbeGetPositions, &hist);
+  ASSERT_EQ(1, hist.count);
+
+  fzf_reset_timing();
+  fzf_get_timing(ProbeGetScore, &hist);
+  ASSERT_EQ(0, hist.count);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+}
+
+TEST(Timing, traceHook) {
+  trace_counter_t counter = {0, 0};
+  fzf_set_trace_hook(count_trace, &counter);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  fzf_get_score("src/fzf", pat, NULL);
+  fzf_get_score("asdf", pat, NULL);
+  fzf_set_trace_hook(NULL, NULL);
+  fzf_get_score("asdf", pat, NULL);
+
+  ASSERT_EQ(2, counter.enter);
+  ASSERT_EQ(2, counter.exit);
+  fzf_free_pattern(pat);
+}
+
+TEST(Corpus, append) {
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  fzf_corpus_append(corpus, "src/fzf.c", 9);
+  fzf_corpus_append(corpus, "lua/fzf_lib.lua_ignored", 15);
+  ASSERT_EQ(2, corpus->count);
+
+  size_t len = 0;
+  ASSERT_EQ("src/fzf.c", fzf_corpus_get(corpus, 0, &len));
+  ASSERT_EQ(9, len);
+  ASSERT_EQ("lua/fzf_lib.lua", fzf_corpus_get(corpus, 1, &len));
+  ASSERT_EQ(15, len);
+  fzf_free_corpus(corpus);
+}
+
+static fzf_corpus_t *make_corpus(char **input) {
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  for (size_t i = 0; input[i] != NULL; ++i) {
+    fzf_corpus_append(corpus, input[i], strlen(input[i]));
+  }
+  return corpus;
+}
+
+TEST(Corpus, basenameFirst) {
+  char *input[] = {"src/fzf/main.c", "lua/fzf_lib.lua", "fzf", "fzf/a/fzf.c",
+                   NULL};
+  fzf_corpus_t *corpus = make_corpus(input);
+  fzf_corpus_basename_first(corpus, true);
+  fzf_corpus_append(corpus, "test/fzf.h", 10);
+  ASSERT_EQ(8, corpus->basenames[0]);
+  ASSERT_EQ(0, corpus->basenames[2]);
+  ASSERT_EQ(5, corpus->basenames[4]);
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf !test", true);
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(4, matches.size);
+  // the file name doesn't contain the term, the whole path is used
+  ASSERT_EQ(fzf_get_score("src/fzf/main.c", pat, slab), matches.data[0].score);
+  ASSERT_EQ(fzf_get_score("fzf_lib.lua", pat, slab), matches.data[1].score);
+  ASSERT_EQ(fzf_get_score("fzf.c", pat, slab), matches.data[3].score);
+
+  fzf_result_buf_t *res = fzf_make_result_buf(corpus, &matches, pat, slab);
+  ASSERT_EQ(4, res->begin[0]);
+  ASSERT_EQ(4, res->begin[1]);
+  ASSERT_EQ(6, res->begin[3]);
+  ASSERT_EQ(9, res->end[3]);
+  fzf_release_result_buf(res);
+
+  fzf_corpus_basename_first(corpus, false);
+  ASSERT_EQ((void *)NULL, (void *)corpus->basenames);
+
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Corpus, normalize) {
+  // "le café", "cafe", "naïve café"
+  char *input[] = {"le caf\xc3\xa9", "cafe", "na\xc3\xafve caf\xc3\xa9",
+                   "tea", NULL};
+  fzf_corpus_t *corpus = make_corpus(input);
+  fzf_corpus_normalize(corpus, true);
+  fzf_corpus_append(corpus, "\xe1\xb8\x89\x61\x66\xc3\xa9", 7);
+  fzf_normalized_t *norm = corpus->normalized;
+  ASSERT_EQ(3, norm->count);
+  ASSERT_EQ(1, norm->slots[0]);
+  ASSERT_EQ(0, norm->slots[1]);
+  ASSERT_EQ(0, norm->slots[3]);
+  ASSERT_EQ(3, norm->slots[4]);
+  ASSERT_EQ(0, memcmp("cafe", norm->data + norm->offsets[2], 4));
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "cafe", true);
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(1, matches.size);
+  fzf_free_pattern(pat);
+
+  pat = fzf_parse_pattern(CaseSmart, true, "cafe", true);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(4, matches.size);
+  ASSERT_EQ(fzf_get_score("le caf\xc3\xa9", pat, slab), matches.data[0].score);
+
+  fzf_result_buf_t *res = fzf_make_result_buf(corpus, &matches, pat, slab);
+  // ranges cover the whole rune of a normalized letter
+  ASSERT_EQ(3, res->begin[0]);
+  ASSERT_EQ(8, res->end[0]);
+  ASSERT_EQ(7, res->begin[2]);
+  ASSERT_EQ(12, res->end[2]);
+  ASSERT_EQ(0, res->begin[3]);
+  ASSERT_EQ(7, res->end[3]);
+  fzf_release_result_buf(res);
+
+  // without the copies every item is normalized on the fly, same results
+  int32_t score = matches.data[2].score;
+  fzf_corpus_normalize(corpus, false);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(4, matches.size);
+  ASSERT_EQ(score, matches.data[2].score);
+  fzf_top_k(corpus, pat, slab, NULL, 2, &matches);
+  ASSERT_EQ(2, matches.size);
+  ASSERT_EQ(1, matches.data[0].idx);
+  res = fzf_make_result_buf(corpus, &matches, pat, slab);
+  ASSERT_EQ(0, res->begin[0]);
+  ASSERT_EQ(4, res->end[0]);
+  fzf_release_result_buf(res);
+
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Corpus, pathTrie) {
+  char *input[] = {"src/main/fzf.c", "src/main/fzf.h", "src/main", "README.md",
+                   "src/lib/fzf.lua", "src/main/fzf_test.c", NULL};
+  fzf_corpus_t *corpus = make_corpus(input);
+  fzf_corpus_path_trie(corpus, true);
+  fzf_trie_t *trie = corpus->trie;
+  ASSERT_EQ(6, trie->count);
+  uint32_t order[] = {3, 4, 2, 0, 1, 5};
+  uint32_t shared[] = {0, 0, 4, 8, 13, 12};
+  for (size_t i = 0; i < 6; i++) {
+    ASSERT_EQ(order[i], trie->order[i]);
+    ASSERT_EQ(shared[i], trie->shared[i]);
+  }
+  // scored one by one until the trie is built again
+  fzf_corpus_append(corpus, "src/main/Fzf.c", 14);
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  const char *prompts[] = {"fzf", "smf", "Fzf", "mainc | lua", "sf !test",
+                           "^src fzf", NULL};
+  fzf_matches_t plain;
+  fzf_matches_t walked;
+  fzf_matches_init(&plain);
+  fzf_matches_init(&walked);
+  for (size_t p = 0; prompts[p]; p++) {
+    char prompt[16];
+    strcpy(prompt, prompts[p]);
+    fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, prompt, true);
+    fzf_score_all(corpus, pat, slab, NULL, &walked);
+    fzf_corpus_path_trie(corpus, false);
+    fzf_score_all(corpus, pat, slab, NULL, &plain);
+    fzf_corpus_path_trie(corpus, true);
+    ASSERT_EQ(plain.size, walked.size);
+    for (size_t i = 0; i < plain.size; i++) {
+      ASSERT_EQ(plain.data[i].idx, walked.data[i].idx);
+      ASSERT_EQ(plain.data[i].score, walked.data[i].score);
+    }
+    fzf_free_pattern(pat);
+  }
+  if (fzf_get_stats(slab)) {
+    ASSERT_TRUE(fzf_get_stats(slab)->trie_shared_bytes > 0);
+  }
+
+  fzf_matches_free(&plain);
+  fzf_matches_free(&walked);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Corpus, frontCoded) {
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  size_t total = 0;
+  for (size_t i = 0; i < 40; i++) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "src/main/java/%s/Fzf%zu.java",
+                       i % 3 ? "lib" : "test", (i * 7) % 40);
+    fzf_corpus_append(corpus, buf, (size_t)len);
+    total += (size_t)len;
+  }
+  fzf_front_coded_t *fc = fzf_make_front_coded(corpus);
+  ASSERT_EQ(40, fzf_front_coded_count(fc));
+  ASSERT_TRUE(fc->size < total / 2);
+  for (size_t i = 0; i < 40; i++) {
+    char buf[64];
+    size_t len;
+    const char *item = fzf_corpus_get(corpus, i, &len);
+    ASSERT_EQ(len, fzf_front_coded_get(fc, i, buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(item, buf, len + 1));
+  }
+  char small[5];
+  ASSERT_EQ(28, fzf_front_coded_get(fc, 0, small, sizeof(small)));
+  ASSERT_EQ("src/", small);
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  const char *prompts[] = {"fzf", "smjf1", "Fzf", "test | lib1", "jf !test",
+                           "'java$", "", NULL};
+  fzf_matches_t plain;
+  fzf_matches_t coded;
+  fzf_matches_init(&plain);
+  fzf_matches_init(&coded);
+  for (size_t p = 0; prompts[p]; p++) {
+    char prompt[16];
+    strcpy(prompt, prompts[p]);
+    fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, prompt, true);
+    // same matches, in byte order of the items
+    fzf_score_all(corpus, pat, slab, NULL, &plain);
+    fzf_front_coded_score_all(fc, pat, slab, NULL, &coded);
+    ASSERT_EQ(plain.size, coded.size);
+    int32_t scores[40] = {0};
+    for (size_t i = 0; i < plain.size; i++) {
+      scores[plain.data[i].idx] = plain.data[i].score;
+    }
+    for (size_t i = 0; i < coded.size; i++) {
+      ASSERT_EQ(scores[coded.data[i].idx], coded.data[i].score);
+    }
+    // the same top k
+    for (size_t k = 1; k < 40; k += 9) {
+      fzf_top_k(corpus, pat, slab, NULL, k, &plain);
+      fzf_front_coded_top_k(fc, pat, slab, NULL, k, &coded);
+      ASSERT_EQ(plain.size, coded.size);
+      for (size_t i = 0; i < plain.size; i++) {
+        ASSERT_EQ(plain.data[i].idx, coded.data[i].idx);
+        ASSERT_EQ(plain.data[i].score, coded.data[i].score);
+      }
+    }
+    fzf_free_pattern(pat);
+  }
+  if (fzf_get_stats(slab)) {
+    ASSERT_TRUE(fzf_get_stats(slab)->trie_shared_bytes > 0);
+  }
+
+  fzf_matches_free(&plain);
+  fzf_matches_free(&coded);
+  fzf_free_slab(slab);
+  fzf_free_front_coded(fc);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Corpus, dedup) {
+  const char *items[] = {"src/fzf.c", "README.md", "src/fzf.c", "fzf",
+                         "src/fzf.c", "fzf",       "lua/fzf_lib.lua"};
+  fzf_corpus_t *corpus = fzf_make_dedup_corpus();
+  for (size_t i = 0; i < 7; i++) {
+    fzf_corpus_append(corpus, items[i], strlen(items[i]));
+  }
+  ASSERT_EQ(4, fzf_corpus_count(corpus));
+  ASSERT_EQ(7, fzf_corpus_inputs(corpus));
+  size_t n = 0;
+  const uint32_t *fanout = fzf_corpus_fanout(corpus, 0, &n);
+  ASSERT_EQ(3, n);
+  ASSERT_EQ(0, fanout[0]);
+  ASSERT_EQ(2, fanout[1]);
+  ASSERT_EQ(4, fanout[2]);
+
+  // every distinct item is scored once
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_top_k(corpus, pat, slab, NULL, 10, &matches);
+  ASSERT_EQ(3, matches.size);
+  if (fzf_get_stats(slab)) {
+    ASSERT_EQ(3, fzf_get_stats(slab)->fuzzy_v2_calls);
+  }
+
+  fzf_matches_t expanded;
+  fzf_matches_init(&expanded);
+  fzf_expand_matches(corpus, &matches, &expanded);
+  uint32_t order[] = {3, 5, 0, 2, 4, 6};
+  ASSERT_EQ(6, expanded.size);
+  for (size_t i = 0; i < 6; i++) {
+    ASSERT_EQ(order[i], expanded.data[i].idx);
+  }
+  ASSERT_EQ(matches.data[0].score, expanded.data[1].score);
+
+  // the fan out table follows appends
+  fzf_corpus_append(corpus, "fzf", 3);
+  fzf_corpus_fanout(corpus, 2, &n);
+  ASSERT_EQ(3, n);
+
+  // many distinct items grow the hash table
+  for (size_t i = 0; i < 5000; i++) {
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%zu/fzf.c", i % 2500);
+    fzf_corpus_append(corpus, buf, (size_t)len);
+  }
+  ASSERT_EQ(2504, fzf_corpus_count(corpus));
+  ASSERT_EQ(5008, fzf_corpus_inputs(corpus));
+  fanout = fzf_corpus_fanout(corpus, 2503, &n);
+  ASSERT_EQ(2, n);
+  ASSERT_EQ(2507, fanout[0]);
+  ASSERT_EQ(5007, fanout[1]);
+
+  fzf_matches_free(&expanded);
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Corpus, loadFile) {
+  char path[] = "/tmp/fzf_corpus_XXXXXX";
+  int fd = mkstemp(path);
+  const char content[] = "src/fzf.c\nREADME.md\r\n\nlua/fzf_lib.lua";
+  ASSERT_EQ(sizeof(content) - 1, write(fd, content, sizeof(content) - 1));
+  close(fd);
+
+  fzf_corpus_t *corpus = fzf_load_corpus(path);
+  ASSERT_EQ(4, corpus->count);
+  size_t len = 0;
+  ASSERT_EQ_MEM("README.md", fzf_corpus_get(corpus, 1, &len), 9);
+  ASSERT_EQ(9, len);
+  fzf_corpus_get(corpus, 2, &len);
+  ASSERT_EQ(0, len);
+  ASSERT_EQ_MEM("lua/fzf_lib.lua", fzf_corpus_get(corpus, 3, &len), 15);
+  ASSERT_EQ(15, len);
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf c$", true);
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(1, matches.size);
+  ASSERT_EQ(0, matches.data[0].idx);
+
+  // appending moves the items out of the mapping
+  fzf_corpus_append(corpus, "fzf.c", 5);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(2, matches.size);
+  ASSERT_EQ_MEM("README.md", fzf_corpus_get(corpus, 1, &len), 9);
+
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+  unlink(path);
+
+  ASSERT_EQ((void *)NULL, (void *)fzf_load_corpus(path));
+}
+
+TEST(Index, saveAndLoad) {
+  char list[] = "/tmp/fzf_list_XXXXXX";
+  int fd = mkstemp(list);
+  const char content[] = "src/fzf.c\nREADME.md\nlua/fzf_lib.lua\n";
+  ASSERT_EQ(sizeof(content) - 1, write(fd, content, sizeof(content) - 1));
+  close(fd);
+  char index[sizeof(list) + 4];
+  snprintf(index, sizeof(index), "%s.idx", list);
+
+  fzf_corpus_t *corpus = fzf_load_corpus(list);
+  ASSERT_TRUE(fzf_save_index(corpus, index, list));
+  ASSERT_EQ((void *)NULL, (void *)fzf_load_index(index, "/tmp"));
+
+  fzf_corpus_t *loaded = fzf_load_index(index, list);
+  ASSERT_TRUE(loaded != NULL);
+  ASSERT_EQ(corpus->count, loaded->count);
+  for (size_t i = 0; i < corpus->count; i++) {
+    size_t len = 0;
+    const char *item = fzf_corpus_get(corpus, i, &len);
+    size_t loaded_len = 0;
+    ASSERT_EQ_MEM(item, fzf_corpus_get(loaded, i, &loaded_len), len);
+    ASSERT_EQ(len, loaded_len);
+    ASSERT_EQ(fzf_char_mask(item, len), loaded->masks[i]);
+  }
+
+  // items without the bytes of a term are rejected before scoring
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_score_all(loaded, pat, slab, NULL, &matches);
+  ASSERT_EQ(2, matches.size);
+  if (fzf_get_stats(slab)) {
+    ASSERT_EQ(1, fzf_get_stats(slab)->prefilter_rejects);
+    ASSERT_EQ(2, fzf_get_stats(slab)->fuzzy_v2_calls);
+  }
+
+  fzf_corpus_append(loaded, "fzf.h", 5);
+  fzf_score_all(loaded, pat, slab, NULL, &matches);
+  ASSERT_EQ(3, matches.size);
+  ASSERT_EQ_MEM("README.md", fzf_corpus_get(loaded, 1, NULL), 9);
+  fzf_free_corpus(loaded);
+
+  // changing the root invalidates the index
+  fd = open(list, O_WRONLY | O_APPEND);
+  ASSERT_EQ(6, write(fd, "fzf.h\n", 6));
+  close(fd);
+  ASSERT_EQ((void *)NULL, (void *)fzf_load_index(index, list));
+
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+  unlink(index);
+  unlink(list);
+  ASSERT_EQ((void *)NULL, (void *)fzf_load_index(index, list));
+}
+
+TEST(BatchScore, scoreAllAndTopK) {
+  char *input[] = {"lua/fzf_lib.lua", "README.md", "src/fzf.c", "src/fzf.h",
+                   "fzf",             NULL};
+  fzf_corpus_t *corpus = make_corpus(input);
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(4, matches.size);
+  ASSERT_EQ(0, matches.data[0].idx);
+  ASSERT_EQ(2, matches.data[1].idx);
+  ASSERT_EQ(fzf_get_score("src/fzf.c", pat, slab), matches.data[1].score);
+
+  // same score, shorter items and then input order win
+  fzf_top_k(corpus, pat, slab, NULL, 3, &matches);
+  ASSERT_EQ(3, matches.size);
+  ASSERT_EQ(4, matches.data[0].idx);
+  ASSERT_EQ(2, matches.data[1].idx);
+  ASSERT_EQ(3, matches.data[2].idx);
+
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(BatchScore, blendWeights) {
+  char *input[] = {"lua/fzf_lib.lua", "README.md", "src/fzf.c", "src/fzf.h",
+                   "fzf",             NULL};
+  fzf_corpus_t *corpus = make_corpus(input);
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  int32_t score = fzf_get_score("src/fzf.h", pat, slab);
+
+  // README.md doesn't match, its weight must not make it a match
+  float weights[] = {0, 1000, 0, 10};
+  fzf_blend_t blend = {weights, 4, BlendAdd, 2};
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_top_k(corpus, pat, slab, &blend, 2, &matches);
+  ASSERT_EQ(2, matches.size);
+  ASSERT_EQ(3, matches.data[0].idx);
+  ASSERT_EQ(score + 20, matches.data[0].score);
+  ASSERT_EQ(4, matches.data[1].idx);
+
+  blend = (fzf_blend_t){weights, 4, BlendScale, 0.5f};
+  fzf_score_all(corpus, pat, slab, &blend, &matches);
+  ASSERT_EQ(4, matches.size);
+  ASSERT_EQ(score * 6, matches.data[2].score);
+
+  // negative weights keep the item matched
+  weights[2] = -100;
+  blend.mode = BlendAdd;
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, false, true, 2);
+  fzf_stream_set_prompt(stream, "fzf", slab);
+  fzf_stream_push(stream, (const char **)input, NULL, 5, slab);
+  ASSERT_EQ(2, fzf_stream_top(stream)->data[1].idx);
+  fzf_stream_set_blend(stream, &blend, slab);
+  ASSERT_EQ(4, fzf_stream_matched(stream));
+  const fzf_matches_t *top = fzf_stream_top(stream);
+  ASSERT_EQ(3, top->data[0].idx);
+  ASSERT_EQ(4, top->data[1].idx);
+  fzf_stream_set_blend(stream, NULL, slab);
+  ASSERT_EQ(2, fzf_stream_top(stream)->data[1].idx);
+
+  fzf_free_stream(stream);
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+static void assert_stream_top(fzf_stream_t *stream, fzf_slab_t *slab) {
+  fzf_matches_t expected;
+  fzf_matches_init(&expected);
+  char *prompt = strdup(stream->prompt);
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, prompt, true);
+  fzf_top_k(stream->corpus, pat, slab, NULL, stream->k, &expected);
+
+  const fzf_matches_t *top = fzf_stream_top(stream);
+  ASSERT_EQ(expected.size, top->size);
+  for (size_t i = 0; i < top->size; i++) {
+    ASSERT_EQ(expected.data[i].idx, top->data[i].idx);
+    ASSERT_EQ(expected.data[i].score, top->data[i].score);
+  }
+  fzf_free_pattern(pat);
+  free(prompt);
+  fzf_matches_free(&expected);
+}
+
+TEST(Stream, pushAndNarrow) {
+  const char *chunk1[] = {"src/fzf.c", "README.md", "lua/fzf_lib.lua"};
+  const char *chunk2[] = {"test/test.c", "src/fzf.h", "fzf", "Makefile"};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, false, true, 2);
+
+  fzf_stream_set_prompt(stream, "f", slab);
+  fzf_stream_push(stream, chunk1, NULL, 3, slab);
+  ASSERT_EQ(2, fzf_stream_matched(stream));
+  assert_stream_top(stream, slab);
+
+  fzf_stream_push(stream, chunk2, NULL, 4, slab);
+  ASSERT_EQ(5, fzf_stream_matched(stream));
+  assert_stream_top(stream, slab);
+  ASSERT_EQ(5, fzf_stream_top(stream)->data[0].idx);
+
+  fzf_stream_set_prompt(stream, "fzf", slab);
+  ASSERT_EQ(4, fzf_stream_matched(stream));
+  assert_stream_top(stream, slab);
+
+  fzf_stream_set_prompt(stream, "fzf !lua", slab);
+  ASSERT_EQ(3, fzf_stream_matched(stream));
+  assert_stream_top(stream, slab);
+
+  fzf_stream_set_prompt(stream, "fzf | make", slab);
+  ASSERT_EQ(5, fzf_stream_matched(stream));
+  assert_stream_top(stream, slab);
+
+  fzf_stream_set_prompt(stream, "", slab);
+  ASSERT_EQ(7, fzf_stream_matched(stream));
+  ASSERT_EQ(5, fzf_stream_top(stream)->data[0].idx);
+  const fzf_matches_t *all = fzf_stream_all(stream);
+  uint32_t order[] = {5, 6, 0, 1, 4, 3, 2};
+  ASSERT_EQ(7, all->size);
+  for (size_t i = 0; i < 7; i++) {
+    ASSERT_EQ(order[i], all->data[i].idx);
+  }
+
+  fzf_free_stream(stream);
+  fzf_free_slab(slab);
+}
+
+TEST(Stream, resultBuffer) {
+  const char *items[] = {"src/fzf.c", "README.md", "lua/fzf_lib.lua", "fzf"};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, false, true, 2);
+  fzf_stream_set_prompt(stream, "fzf", slab);
+  fzf_stream_push(stream, items, NULL, 4, slab);
+
+  fzf_result_buf_t *top = fzf_stream_result(stream, false, false, slab);
+  ASSERT_EQ(2, top->size);
+  ASSERT_EQ(3, top->idx[0]);
+  ASSERT_EQ(0, top->idx[1]);
+  ASSERT_EQ(fzf_get_score("fzf", stream->pattern, slab), top->score[0]);
+  ASSERT_EQ((void *)NULL, (void *)top->begin);
+
+  fzf_result_buf_t *all = fzf_stream_result(stream, true, true, slab);
+  ASSERT_EQ(3, all->size);
+  ASSERT_EQ(0, all->begin[0]);
+  ASSERT_EQ(3, all->end[0]);
+  ASSERT_EQ(4, all->begin[1]);
+  ASSERT_EQ(7, all->end[1]);
+  ASSERT_EQ(2, all->idx[2]);
+  ASSERT_EQ(4, all->begin[2]);
+  ASSERT_EQ(7, all->end[2]);
+
+  // buffers outlive changes of the stream and are freed by their last owner
+  fzf_stream_set_prompt(stream, "readme", slab);
+  ASSERT_EQ(3, top->idx[0]);
+  ASSERT_TRUE(fzf_retain_result_buf(top) == top);
+  fzf_release_result_buf(top);
+  ASSERT_EQ(1, top->refs);
+  fzf_release_result_buf(top);
+  fzf_release_result_buf(all);
+
+  fzf_free_stream(stream);
+  fzf_free_slab(slab);
+}
+
+TEST(Stream, nth) {
+  const char *items[] = {"src/fzf.c:1:main", "README.md:3:fzf",
+                         "lua/fzf_lib.lua:9:setup"};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, false, true, 3);
+  fzf_stream_push(stream, items, NULL, 3, slab);
+  fzf_stream_set_prompt(stream, "fzf", slab);
+  ASSERT_EQ(3, stream->matched.size);
+
+  ASSERT_FALSE(fzf_stream_set_nth(stream, ':', "x", slab));
+  ASSERT_EQ(3, stream->matched.size);
+  ASSERT_TRUE(fzf_stream_set_nth(stream, ':', "3", slab));
+  ASSERT_EQ(1, stream->matched.size);
+  ASSERT_EQ(1, stream->matched.data[0].idx);
+
+  // the fields stay selected when the prompt changes
+  fzf_stream_set_prompt(stream, "s", slab);
+  ASSERT_EQ(1, stream->matched.size);
+  ASSERT_EQ(2, stream->matched.data[0].idx);
+  ASSERT_TRUE(fzf_stream_set_nth(stream, ':', NULL, slab));
+  ASSERT_EQ(2, stream->matched.size);
+
+  fzf_free_stream(stream);
+  fzf_free_slab(slab);
+}
+
+TEST(Stream, normalize) {
+  // "le café", "cafe", "tea"
+  const char *items[] = {"le caf\xc3\xa9", "cafe", "tea"};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, true, true, 3);
+  ASSERT_TRUE(stream->corpus->normalized != NULL);
+  fzf_stream_set_prompt(stream, "cafe", slab);
+  fzf_stream_push(stream, items, NULL, 3, slab);
+  ASSERT_EQ(2, fzf_stream_matched(stream));
+  fzf_free_stream(stream);
+
+  // the flag decides, not whether the corpus keeps normalized copies
+  stream = fzf_make_stream(CaseSmart, false, true, 3);
+  fzf_corpus_normalize(stream->corpus, true);
+  fzf_stream_set_prompt(stream, "cafe", slab);
+  fzf_stream_push(stream, items, NULL, 3, slab);
+  ASSERT_EQ(1, fzf_stream_matched(stream));
+  fzf_free_stream(stream);
+  fzf_free_slab(slab);
+}
+
+TEST(Stream, rowCache) {
+  const char *items[] = {"src/fzf.c", "README.md", "lua/fzf_lib.lua",
+                         "test/test.c", "src/fzf.h", "fzf", "FZF_LIB.md"};
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, false, true, 3);
+  fzf_stream_row_cache(stream, true);
+  fzf_stream_push(stream, items, NULL, 4, slab);
+
+  // typing, pushing in between, a space, smart case and backspaces
+  const char *prompts[] = {"f", "fz", "fzf", "fzfl", "fzf", "fzf ", "fzF",
+                           "fzfl", "fzflib", "f", NULL};
+  for (size_t p = 0; prompts[p]; p++) {
+    fzf_stream_set_prompt(stream, prompts[p], slab);
+    assert_stream_top(stream, slab);
+    if (p == 1) {
+      fzf_stream_push(stream, items + 4, NULL, 3, slab);
+      assert_stream_top(stream, slab);
+    }
+  }
+  if (fzf_get_stats(slab)) {
+    ASSERT_TRUE(fzf_get_stats(slab)->cached_rows > 0);
+  }
+
+  // other patterns are scored as usual
+  fzf_stream_set_prompt(stream, "fzf !lua", slab);
+  assert_stream_top(stream, slab);
+  ASSERT_TRUE(stream->rows->term == NULL);
+  fzf_stream_row_cache(stream, false);
+  fzf_stream_set_prompt(stream, "fzf", slab);
+  assert_stream_top(stream, slab);
+
+  fzf_free_stream(stream);
+  fzf_free_slab(slab);
+}
+
+static fzf_corpus_t *make_large_corpus(size_t n) {
+  const char *names[] = {"src/fzf.c", "lua/fzf_lib.lua", "README.md",
+                         "test/test.c", "lua/telescope/_extensions/fzf.lua"};
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  char buf[64];
+  for (size_t i = 0; i < n; i++) {
+    int len = snprintf(buf, sizeof(buf), "%zu/%s", i % 97, names[i % 5]);
+    fzf_corpus_append(corpus, buf, (size_t)len);
+  }
+  return corpus;
+}
+
+TEST(BatchScore, sortMatches) {
+  fzf_corpus_t *corpus = make_large_corpus(50000);
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf lua", true);
+
+  fzf_matches_t matches;
+  fzf_matches_init(&matches);
+  fzf_score_all(corpus, pat, slab, NULL, &matches);
+  ASSERT_EQ(20000, matches.size);
+  fzf_sort_matches(corpus, &matches);
+  ASSERT_EQ(20000, matches.size);
+  for (size_t i = 1; i < matches.size; i++) {
+    fzf_match_t a = matches.data[i - 1];
+    fzf_match_t b = matches.data[i];
+    ASSERT_TRUE(a.score >= b.score);
+    if (a.score == b.score) {
+      ASSERT_TRUE(corpus->lens[a.idx] <= corpus->lens[b.idx]);
+      if (corpus->lens[a.idx] == corpus->lens[b.idx]) {
+        ASSERT_TRUE(a.idx < b.idx);
+      }
+    }
+  }
+
+  fzf_matches_t top;
+  fzf_matches_init(&top);
+  fzf_top_k(corpus, pat, slab, NULL, 100, &top);
+  ASSERT_EQ_MEM(top.data, matches.data, 100 * sizeof(fzf_match_t));
+
+  fzf_matches_free(&top);
+  fzf_matches_free(&matches);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(BatchScore, boundPruning) {
+  fzf_corpus_t *corpus = make_large_corpus(5000);
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_enable_stats(slab);
+  char *patterns[] = {"fzf", "zf", "tl", "lua$ fzf", "fzf | test", "!read c$",
+                      "'tele"};
+  fzf_matches_t all;
+  fzf_matches_t top;
+  fzf_matches_init(&all);
+  fzf_matches_init(&top);
+  for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+    fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, patterns[i], true);
+    fzf_score_all(corpus, pat, slab, NULL, &all);
+    fzf_sort_matches(corpus, &all);
+    fzf_top_k(corpus, pat, slab, NULL, 50, &top);
+    ASSERT_EQ(all.size < 50 ? all.size : 50, top.size);
+    ASSERT_EQ_MEM(all.data, top.data, top.size * sizeof(fzf_match_t));
+    fzf_free_pattern(pat);
+  }
+  // once the top k is full of perfect matches the rest is skipped
+  if (fzf_get_stats(slab)) {
+    ASSERT_TRUE(fzf_get_stats(slab)->bound_prunes > 4000);
+  }
+
+  fzf_matches_free(&top);
+  fzf_matches_free(&all);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Job, collect) {
+  fzf_corpus_t *corpus = make_large_corpus(10000);
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_pattern_t *pat = fzf_parse_pattern(CaseSmart, false, "fzf", true);
+  fzf_matches_t expected;
+  fzf_matches_init(&expected);
+  fzf_top_k(corpus, pat, slab, NULL, 20, &expected);
+
+  fzf_job_t *job =
+      fzf_submit_job(corpus, "fzf", CaseSmart, false, true, 20, 0, 0);
+  const fzf_matches_t *res = fzf_job_collect(job);
+  ASSERT_EQ(JobDone, fzf_job_poll(job));
+  ASSERT_EQ(6000, fzf_job_matched(job));
+  ASSERT_EQ(expected.size, res->size);
+  for (size_t i = 0; i < res->size; i++) {
+    ASSERT_EQ(expected.data[i].idx, res->data[i].idx);
+    ASSERT_EQ(expected.data[i].score, res->data[i].score);
+  }
+  fzf_result_buf_t *buf = fzf_job_result(job);
+
+  fzf_free_job(job);
+  ASSERT_EQ(expected.size, buf->size);
+  ASSERT_EQ(expected.data[19].idx, buf->idx[19]);
+  fzf_release_result_buf(buf);
+  fzf_matches_free(&expected);
+  fzf_free_pattern(pat);
+  fzf_free_slab(slab);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Job, cancel) {
+  fzf_corpus_t *corpus = make_large_corpus(100000);
+  fzf_job_t *job =
+      fzf_submit_job(corpus, "fzf lua", CaseSmart, false, true, 20, 0, 0);
+  fzf_job_cancel(job);
+  ASSERT_EQ(JobCancelled, fzf_job_poll(job));
+  ASSERT_EQ((void *)NULL, (void *)fzf_job_collect(job));
+  ASSERT_EQ((void *)NULL, (void *)fzf_job_result(job));
+  fzf_free_job(job);
+
+  // freeing a running job cancels it
+  job = fzf_submit_job(corpus, "fzf", CaseSmart, false, true, 20, 0, 0);
+  fzf_free_job(job);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Job, normalize) {
+  // "le café", "cafe", "tea"
+  char *input[] = {"le caf\xc3\xa9", "cafe", "tea", NULL};
+  fzf_corpus_t *corpus = make_corpus(input);
+  // without normalized copies the job normalizes the items itself
+  fzf_job_t *job =
+      fzf_submit_job(corpus, "cafe", CaseSmart, true, true, 10, 0, 0);
+  ASSERT_EQ(2, fzf_job_matched(job));
+  fzf_free_job(job);
+
+  fzf_corpus_normalize(corpus, true);
+  job = fzf_submit_job(corpus, "cafe", CaseSmart, true, true, 10, 0, 0);
+  ASSERT_EQ(2, fzf_job_matched(job));
+  fzf_free_job(job);
+  job = fzf_submit_job(corpus, "cafe", CaseSmart, false, true, 10, 0, 0);
+  ASSERT_EQ(1, fzf_job_matched(job));
+  fzf_free_job(job);
+  fzf_free_corpus(corpus);
+}
+
+TEST(Scheduler, priorityAndOwner) {
+  fzf_scheduler_shutdown();
+  fzf_scheduler_init(1);
+  fzf_corpus_t *corpus = make_large_corpus(200000);
+
+  fzf_job_t *background =
+      fzf_submit_job(corpus, "fzf", CaseSmart, false, true, 20, 0, 0);
+  fzf_job_t *stale =
+      fzf_submit_job(corpus, "f", CaseSmart, false, true, 20, 1, 42);
+  fzf_job_t *focused =
+      fzf_submit_job(corpus, "fzf lua", CaseSmart, false, true, 20, 1, 42);
+  ASSERT_EQ(1, fzf_scheduler_threads());
+  ASSERT_EQ(JobCancelled, fzf_job_poll(stale));
+
+  // the focused job preempts the background job
+  ASSERT_TRUE(fzf_job_collect(focused) != NULL);
+  ASSERT_EQ(JobRunning, fzf_job_poll(background));
+  ASSERT_TRUE(fzf_job_collect(background) != NULL);
+  ASSERT_EQ(120000, fzf_job_matched(background));
+
+  fzf_free_job(background);
+  fzf_free_job(stale);
+  fzf_free_job(focused);
+  fzf_free_corpus(corpus);
+  fzf_scheduler_shutdown();
+  ASSERT_EQ(0, fzf_scheduler_threads());
+  fzf_scheduler_init(0);
+}
+
+static void touch(const char *root, const char *path) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s/%s", root, path);
+  FILE *f = fopen(buf, "w");
+  fclose(f);
+}
+
+static void make_dir(const char *root, const char *path) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s/%s", root, path);
+  mkdir(buf, 0700);
+}
+
+static void remove_path(const char *root, const char *path) {
+  char buf[256];
+  snprintf(buf, sizeof(buf), "%s/%s", root, path);
+  remove(buf);
+}
+
+TEST(Walker, feedsStream) {
+  char root[] = "/tmp/fzf_walk_XXXXXX";
+  ASSERT_TRUE(mkdtemp(root) != NULL);
+  const char *dirs[] = {"src", "lua", "lua/telescope", ".git", "build"};
+  const char *files[] = {"README.md",  "src/fzf.c",
+                         "src/walk.c", "lua/telescope/fzf.lua",
+                         ".git/HEAD",  "build/fzf.so"};
+  for (size_t i = 0; i < 5; i++) {
+    make_dir(root, dirs[i]);
+  }
+  for (size_t i = 0; i < 6; i++) {
+    touch(root, files[i]);
+  }
+
+  fzf_slab_t *slab = fzf_make_default_slab();
+  fzf_stream_t *stream = fzf_make_stream(CaseSmart, false, true, 10);
+  fzf_stream_set_prompt(stream, "fzf", slab);
+
+  // patterns with a slash match the relative path
+  const char *ignore[] = {"build", "src/w*.c"};
+  fzf_walk_opts_t opts = {false, ignore, 2, 2};
+  fzf_walker_t *walker = fzf_walk_start(root, opts);
+  ASSERT_TRUE(walker != NULL);
+  size_t found = 0;
+  while (!fzf_walk_done(walker)) {
+    found += fzf_walk_drain(walker, stream->corpus);
+    fzf_stream_update(stream, slab);
+  }
+  found += fzf_walk_drain(walker, stream->corpus);
+  fzf_stream_update(stream, slab);
+  fzf_free_walker(walker);
+
+  ASSERT_EQ(3, found);
+  ASSERT_EQ(3, fzf_corpus_count(stream->corpus));
+  ASSERT_EQ(2, fzf_stream_matched(stream));
+  const fzf_matches_t *top = fzf_stream_top(stream);
+  ASSERT_EQ(2, top->size);
+  size_t len = 0;
+  ASSERT_EQ("src/fzf.c",
+            fzf_corpus_get(stream->corpus, top->data[0].idx, &len));
+
+  // hidden entries are listed on request
+  opts = (fzf_walk_opts_t){true, NULL, 0, 1};
+  fzf_corpus_t *corpus = fzf_make_corpus();
+  walker = fzf_walk_start(root, opts);
+  while (!fzf_walk_done(walker)) {
+    fzf_walk_drain(walker, corpus);
+  }
+  fzf_walk_drain(walker, corpus);
+  fzf_free_walker(walker);
+  ASSERT_EQ(6, fzf_corpus_count(corpus));
+  fzf_free_corpus(corpus);
+
+  ASSERT_EQ((void *)NULL, (void *)fzf_walk_start("/nonexistent/fzf", opts));
+
+  fzf_free_stream(stream);
+  fzf_free_slab(slab);
+  for (size_t i = 6; i > 0; i--) {
+    remove_path(root, files[i - 1]);
+  }
+  for (size_t i = 5; i > 0; i--) {
+    remove_path(root, dirs[i - 1]);
+  }
+  remove(root);
+}
+
 int main(int argc, char **argv) {
   exam_init(argc, argv);
   return exam_run();